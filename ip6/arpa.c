@@ -0,0 +1,135 @@
+/*
+ * arpa.c -- SSE 4.1 reverse names under ip6.arpa for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <immintrin.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ip6.h"
+#include "bits.h"
+
+// the name lists the nibbles from last to first. the bytes are reversed
+// (pshufb) and split into nibbles low first, which yields the nibbles in
+// name order, and converted to hex (pshufb). labels are interleaved with
+// dots in text, or preceded by a length octet in wire format (punpck), eight
+// labels per store. names for shorter prefixes are the tail of the full name
+
+static const char text_suffix[2][16] = {
+  { 'i', 'p', '6', '.', 'a', 'r', 'p', 'a', '.', '\0' },
+  { 'i', 'p', '6', '.', 'a', 'r', 'p', 'a', '.', '\n' }
+};
+
+static const char wire_suffix[16] = {
+  3, 'i', 'p', '6', 4, 'a', 'r', 'p', 'a', 0
+};
+
+// write the name for all 128 bits, returns the length of the labels
+__attribute__((always_inline))
+static inline size_t reverse(const void *src, void *dst, bool wire)
+{
+  const __m128i address = _mm_shuffle_epi8(
+    _mm_loadu_si128((const __m128i *)src),
+    _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+  const __m128i hex = _mm_setr_epi8(
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+  const __m128i high =
+    _mm_and_si128(_mm_srli_epi16(address, 4), _mm_set1_epi8(0x0f));
+  const __m128i low = _mm_and_si128(address, _mm_set1_epi8(0x0f));
+  const __m128i digits[2] = {
+    _mm_shuffle_epi8(hex, _mm_unpacklo_epi8(low, high)),
+    _mm_shuffle_epi8(hex, _mm_unpackhi_epi8(low, high)) };
+
+  __m128i labels[4];
+  if (wire) {
+    const __m128i lengths = _mm_set1_epi8(1);
+    labels[0] = _mm_unpacklo_epi8(lengths, digits[0]);
+    labels[1] = _mm_unpackhi_epi8(lengths, digits[0]);
+    labels[2] = _mm_unpacklo_epi8(lengths, digits[1]);
+    labels[3] = _mm_unpackhi_epi8(lengths, digits[1]);
+  } else {
+    const __m128i dots = _mm_set1_epi8('.');
+    labels[0] = _mm_unpacklo_epi8(digits[0], dots);
+    labels[1] = _mm_unpackhi_epi8(digits[0], dots);
+    labels[2] = _mm_unpacklo_epi8(digits[1], dots);
+    labels[3] = _mm_unpackhi_epi8(digits[1], dots);
+  }
+
+  for (uint32_t i = 0; i < 4; i++)
+    _mm_storeu_si128((__m128i *)dst + i, labels[i]);
+  return 64;
+}
+
+// names for prefixes that are not nibble aligned do not exist
+static inline bool valid_prefix(uint32_t prefix)
+{
+  return prefix <= 128 && !(prefix & 3u);
+}
+
+__attribute__((always_inline))
+static inline size_t format_arpa(
+  const void *src, uint32_t prefix, char *dst, uint32_t terminator)
+{
+  reverse(src, dst, false);
+  _mm_storeu_si128((__m128i *)(dst + 64),
+    _mm_loadu_si128((const __m128i *)text_suffix[terminator]));
+  // drop the labels for the nibbles past the prefix
+  const size_t skip = 64 - prefix / 2;
+  if (skip)
+    memmove(dst, dst + skip, 74 - skip);
+  return 73 - skip;
+}
+
+__attribute__((always_inline))
+static inline size_t format_arpa_wire(const void *src, uint32_t prefix, uint8_t *dst)
+{
+  reverse(src, dst, true);
+  _mm_storeu_si128((__m128i *)(dst + 64),
+    _mm_loadu_si128((const __m128i *)wire_suffix));
+  const size_t skip = 64 - prefix / 2;
+  if (skip)
+    memmove(dst, dst + skip, 74 - skip);
+  return 74 - skip;
+}
+
+size_t format_ip6_arpa(const void *src, uint32_t prefix, char *dst)
+{
+  if (unlikely(!valid_prefix(prefix)))
+    return 0u;
+  return format_arpa(src, prefix, dst, 0);
+}
+
+size_t format_ip6_arpa_wire(const void *src, uint32_t prefix, uint8_t *dst)
+{
+  if (unlikely(!valid_prefix(prefix)))
+    return 0u;
+  return format_arpa_wire(src, prefix, dst);
+}
+
+size_t format_ip6_arpa_batch(
+  const uint8_t (*src)[16], size_t count, uint32_t prefix, char *dst)
+{
+  if (unlikely(!valid_prefix(prefix)))
+    return 0u;
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++)
+    length += format_arpa(src[i], prefix, dst + length, 1) + 1;
+  return length;
+}
+
+size_t format_ip6_arpa_wire_batch(
+  const uint8_t (*src)[16], size_t count, uint32_t prefix, uint8_t *dst)
+{
+  if (unlikely(!valid_prefix(prefix)))
+    return 0u;
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++)
+    length += format_arpa_wire(src[i], prefix, dst + length);
+  return length;
+}
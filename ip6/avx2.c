@@ -0,0 +1,279 @@
+/*
+ * avx2.c -- AVX2 parser for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <assert.h>
+#include <immintrin.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include "ip6.h"
+#include "bits.h"
+#include "groups.h"
+#include "expansions.h"
+#include "ip4.h"
+#include "stats.h"
+
+// a 32-byte window always covers the next four groups (4 * 5 bytes), which
+// are resolved in one step. the widths of the groups index group_shuffles
+// as in the SSE 4.1 parser (widths). the first two groups are shuffled in the
+// lower lane, the next two in the upper lane. vpshufb does not cross lanes,
+// the upper lane therefore receives the input from the dword that contains
+// the first digit of the third group onwards (vpermd)
+
+__attribute__((warn_unused_result)) __attribute__((always_inline))
+static inline uint32_t load_shuffle_mask(
+  __m256i *shuffle, __m256i *permute, uint32_t *bytes, uint64_t mask,
+  uint32_t offset)
+{
+  const uint32_t end = (uint32_t)(64u - leading_zeros(mask));
+  const uint64_t delimiters = mask | (~0llu << end);
+  const uint64_t rest1 = clear_lowest_bit(delimiters);
+  const uint64_t rest2 = clear_lowest_bit(rest1);
+  const uint64_t rest3 = clear_lowest_bit(rest2);
+  const uint32_t position0 = (uint32_t)trailing_zeros(delimiters);
+  const uint32_t position1 = (uint32_t)trailing_zeros(rest1);
+  const uint32_t position2 = (uint32_t)trailing_zeros(rest2);
+  const uint32_t position3 = (uint32_t)trailing_zeros(rest3);
+
+  const uint32_t width0 = position0;
+  const uint32_t width1 = position1 - position0 - 1u;
+  const uint32_t width2 = position2 - position1 - 1u;
+  const uint32_t width3 = position3 - position2 - 1u;
+  const uint32_t valid =
+    (width0 < 5u) & (width1 < 5u) & (width2 < 5u) & (width3 < 5u);
+  const uint32_t key =
+    (width0 + 5u * width1 + 25u * width2 + 125u * width3) & (0u - valid);
+  IP6_COUNT_GROUPS(key, valid);
+
+  // the groups start offset bytes into the window. indexes of the third and
+  // fourth group are rebased to the dword that holds the first digit of the
+  // third group, at most 8 bytes in
+  const uint32_t start = (position1 + 1u + offset) & ~3u;
+  const __m128i groups = _mm_load_si128((const __m128i *)group_shuffles[key]);
+  *shuffle = _mm256_set_m128i(
+    _mm_add_epi8(_mm_unpackhi_epi64(groups, groups),
+                 _mm_set1_epi8((int8_t)(offset - start))),
+    _mm_add_epi8(groups, _mm_set1_epi8((int8_t)offset)));
+  *permute = _mm256_add_epi32(
+    _mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3),
+    _mm256_set_m128i(_mm_set1_epi32((int32_t)(start >> 2)), _mm_setzero_si128()));
+
+  const uint32_t count = (uint32_t)count_ones(mask);
+  *bytes += 2u * (count < 4u ? count : 4u);
+
+  const uint32_t shift = position3 < end ? position3 + 1u : end;
+  return shift & (0u - valid);
+}
+
+__attribute__((always_inline))
+static inline __m256i classify_input(
+  __m256i input, uint64_t *colons, uint64_t *non_digits)
+{
+  const __m256i delta_check = _mm256_setr_epi8(
+    -16, -32, -47, 71, 58, -96, 26, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+    -16, -32, -47, 71, 58, -96, 26, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i delta_rebase = _mm256_setr_epi8(
+    0, 0, -47, -47, -54, 0, -86, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, -47, -47, -54, 0, -86, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  *colons = (uint32_t)_mm256_movemask_epi8(
+    _mm256_cmpeq_epi8(input, _mm256_set1_epi8(':')));
+
+  input = _mm256_add_epi8(input, _mm256_set1_epi8(-1));
+  __m256i keys = _mm256_and_si256(
+    _mm256_srli_epi32(input, 4), _mm256_set1_epi8(0x0f));
+
+  *non_digits = (uint32_t)_mm256_movemask_epi8(
+    _mm256_add_epi8(_mm256_shuffle_epi8(delta_check, keys), input));
+  return _mm256_add_epi8(input, _mm256_shuffle_epi8(delta_rebase, keys));
+}
+
+__attribute__((always_inline))
+static inline __m256i classify(
+  const char *src, uint64_t *colons, uint64_t *non_digits)
+{
+  return classify_input(
+    _mm256_loadu_si256((const __m256i*)src), colons, non_digits);
+}
+
+// full-form addresses, eight groups of four digits, have colons at fixed
+// positions. groups 0 to 2 and 3 to 5 are loaded into separate lanes, groups
+// 6 and 7 follow from offset 30, and are converted with a fixed shuffle
+__attribute__((always_inline))
+static inline size_t parse_full(const char *src, void *dst)
+{
+  uint64_t colons, non_digits;
+  const __m256i input = classify_input(_mm256_loadu2_m128i(
+    (const __m128i *)(src + 15), (const __m128i *)src), &colons, &non_digits);
+  if ((colons ^ 0x42104210u) | (non_digits ^ 0x42104210u))
+    return 0u;
+  // the delimiter is not a colon or a dot
+  const __m256i last = classify(src + 30, &colons, &non_digits);
+  if ((((colons ^ 0x010u) | (non_digits ^ 0x210u)) & 0x3ffu) || src[39] == '.')
+    return 0u;
+
+  const __m256i groups = _mm256_setr_epi8(
+    0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -128, -128, -128, -128,
+    0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -128, -128, -128, -128);
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i octets = _mm256_packus_epi16(_mm256_maddubs_epi16(
+    _mm256_shuffle_epi8(input, groups), weights), zero);
+  // the third group of the last window is past the delimiter, shift it out
+  const __m256i tail = _mm256_packus_epi16(_mm256_maddubs_epi16(
+    _mm256_shuffle_epi8(last, groups), weights), zero);
+  _mm_storeu_si128((__m128i *)dst, _mm_or_si128(
+    _mm_or_si128(_mm256_castsi256_si128(octets),
+                 _mm_slli_si128(_mm256_extracti128_si256(octets, 1), 6)),
+    _mm_slli_si128(_mm256_castsi256_si128(tail), 12)));
+  return 39u;
+}
+
+__attribute__((always_inline))
+static inline __m128i convert(__m256i input, __m256i shuffle, __m256i permute)
+{
+  input = _mm256_permutevar8x32_epi32(input, permute);
+  input = _mm256_shuffle_epi8(input, shuffle);
+  input = _mm256_maddubs_epi16(input, _mm256_set1_epi16(0x0110));
+  input = _mm256_packus_epi16(input, input);
+  return _mm_unpacklo_epi32(
+    _mm256_castsi256_si128(input), _mm256_extracti128_si256(input, 1));
+}
+
+__attribute__((noinline))
+size_t parse_ip6_avx2(const char *src, void *dst)
+{
+  uint64_t colons, non_digits;
+  __m256i input = classify(src, &colons, &non_digits);
+
+  // Leading :: requires sepcial handling.
+  // :: is allowed, as is abcd:, but not :abcd.
+  if (unlikely((colons & 3llu) == 1llu))
+    return IP6_REJECT(LEADING_COLON);
+
+  // leading :: is parsed from the second colon, which leaves one empty group
+  // before it as for :: elsewhere. the window is not reloaded, the groups
+  // are shuffled from one byte in
+  const uint32_t leading = (colons & 3llu) == 3llu;
+  if (leading)
+    input = classify(++src, &colons, &non_digits);
+
+  // three groups of four digits likely start a full-form address
+  if (!(((colons ^ 0x210u) | (non_digits ^ 0x210u)) & 0x3fffu)) {
+    const size_t size = parse_full(src, dst);
+    if (likely(size)) {
+      IP6_COUNT(parsed);
+      IP6_COUNT(full);
+      return size;
+    }
+  }
+
+  uint64_t mask;
+  uint64_t delimiter = first_trailing_one(non_digits ^ colons);
+  colons &= (delimiter - 1llu);
+  mask = colons;
+  colons |= delimiter;
+
+  __m256i shuffle, permute;
+  uint32_t size, shift, bytes = 0, loads = 0;
+  if (!(shift = load_shuffle_mask(&shuffle, &permute, &bytes, colons, 0u)))
+    return IP6_REJECT(PATTERN);
+
+  _mm_storel_epi64((__m128i *)dst, convert(input, shuffle, permute));
+
+  size = shift;
+  colons >>= shift;
+
+  while (bytes < 16 && !(delimiter && !colons)) {
+    input = classify(src + size, &colons, &non_digits);
+
+    delimiter = first_trailing_one(non_digits ^ colons);
+    colons &= delimiter - 1;
+    mask |= (colons << size);
+    colons |= delimiter;
+
+    uint8_t *out = (uint8_t*)dst + bytes;
+    loads++;
+    if (!(shift = load_shuffle_mask(&shuffle, &permute, &bytes, colons, 0u)))
+      return IP6_REJECT(PATTERN);
+    size += shift;
+    colons >>= shift;
+
+    _mm_storel_epi64((__m128i *)out, convert(input, shuffle, permute));
+  }
+
+  IP6_COUNT_ITERATIONS(loads);
+  size -= 1u; // Account for delimiter.
+
+  // :: in place of the last group, the loop may stop at eight groups before
+  // the empty group that follows, which must not be followed by digits
+  if (unlikely(src[size] == ':' && src[size - 1] == ':')) {
+    const uint8_t next = (uint8_t)src[size + 1];
+    if ((uint8_t)(next - '0') < 10u || (uint8_t)((next | 0x20) - 'a') < 6u)
+      return IP6_REJECT(COMPRESSED);
+    mask |= 1llu << size;
+    bytes += 2u;
+    size++;
+  }
+
+  src -= leading;
+  mask = (mask << leading) | leading;
+  size += leading;
+  assert(size <= INET6_ADDRSTRLEN);
+
+  // embedded IPv4 address, the last group is actually the first octet
+  if (unlikely(src[size] == '.')) {
+    if (!mask)
+      return IP6_REJECT(EMBEDDED);
+    uint32_t octets, length;
+    const uint32_t start = (uint32_t)(64u - leading_zeros(mask));
+    if (!(length = parse_dotted_quad(
+          _mm_loadu_si128((const __m128i *)(src + start)), 0, &octets)))
+      return IP6_REJECT(EMBEDDED);
+    bytes -= 2u;
+    memcpy((uint8_t *)dst + bytes, &octets, sizeof(octets));
+    bytes += 4u;
+    size = start + length;
+    // a hex digit directly following the quad is not a delimiter
+    if (unlikely((uint8_t)((src[size] | 0x20) - 'a') < 6u))
+      return IP6_REJECT(EMBEDDED);
+  }
+
+  if (unlikely(src[size] == ':' || src[size] == '.'))
+    return IP6_REJECT(DELIMITER);
+
+  // a trailing empty group must be part of ::, abcd:: is allowed, abcd: is not
+  const uint64_t last = (1llu << size) >> 1;
+  if (unlikely((mask & last) && !(mask & (last >> 1))))
+    return IP6_REJECT(TRAILING_COLON);
+
+  uint64_t compressed = (mask << 1) & mask;
+  if (compressed) {
+    // :: takes the place of one or more groups (RFC 4291), the empty group
+    // is included in bytes. trailing :: includes an additional empty group
+    bytes -= 2u * ((mask & last) != 0);
+    if ((count_ones(compressed) > 1) || (bytes > 16))
+      return IP6_REJECT(COMPRESSED);
+    // move groups that follow :: to the end, zero the groups in between
+    const uint64_t group = count_ones(mask & (compressed - 1)) - leading;
+    const __m128i expansion =
+      _mm_load_si128((const __m128i *)expansions[group][bytes >> 1]);
+    __m128i address = _mm_loadu_si128((const __m128i *)dst);
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(address, expansion));
+    bytes = 16;
+  }
+
+  if (bytes != 16)
+    return IP6_REJECT(GROUPS);
+
+  IP6_COUNT(parsed);
+  return size;
+}
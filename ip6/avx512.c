@@ -0,0 +1,162 @@
+/*
+ * avx512.c -- AVX-512 (VBMI) parser for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <assert.h>
+#include <immintrin.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include "ip6.h"
+#include "bits.h"
+#include "expansions.h"
+#include "ip4.h"
+
+// a 64-byte window covers any address (INET6_ADDRSTRLEN is 46), there is no
+// loop and no table. colons, digits and letters are classified into mask
+// registers. the positions of the delimiters are compressed into a vector
+// (vpcompressb) from which the source index of each nibble is computed. all
+// nibbles are then gathered in one shot (vpermb)
+
+static const int8_t iota[64] __attribute__((aligned(64))) = {
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+  16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+  32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+  48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63
+};
+
+// group and offset relative to the delimiter of each nibble in the output
+static const int8_t groups_by_nibble[64] __attribute__((aligned(64))) = {
+  0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+  4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+};
+
+static const int8_t offsets_by_nibble[64] __attribute__((aligned(64))) = {
+  -4, -3, -2, -1, -4, -3, -2, -1, -4, -3, -2, -1, -4, -3, -2, -1,
+  -4, -3, -2, -1, -4, -3, -2, -1, -4, -3, -2, -1, -4, -3, -2, -1
+};
+
+__attribute__((noinline))
+size_t parse_ip6_avx512(const char *src, void *dst)
+{
+  const __m512i input = _mm512_loadu_si512((const void *)src);
+
+  uint64_t colons = _mm512_cmpeq_epi8_mask(input, _mm512_set1_epi8(':'));
+
+  // Leading :: requires sepcial handling.
+  // :: is allowed, as is abcd:, but not :abcd.
+  if (unlikely((colons & 3llu) == 1llu))
+    return 0u;
+
+  const __m512i digits = _mm512_sub_epi8(input, _mm512_set1_epi8('0'));
+  const __m512i letters = _mm512_sub_epi8(
+    _mm512_or_si512(input, _mm512_set1_epi8(0x20)), _mm512_set1_epi8('a'));
+  const __mmask64 is_digit =
+    _mm512_cmplt_epu8_mask(digits, _mm512_set1_epi8(10));
+  const __mmask64 is_letter =
+    _mm512_cmplt_epu8_mask(letters, _mm512_set1_epi8(6));
+  const __m512i nibbles = _mm512_mask_add_epi8(
+    digits, is_letter, letters, _mm512_set1_epi8(10));
+
+  const uint64_t hex_digits = is_digit | is_letter;
+  const uint64_t delimiter = first_trailing_one(~(hex_digits | colons));
+  // no delimiter within 64 bytes implies a group exceeds four digits
+  if (unlikely(!delimiter))
+    return 0u;
+
+  colons &= delimiter - 1llu;
+  const uint64_t mask = colons;
+  uint32_t size = (uint32_t)trailing_zeros(delimiter);
+
+  // leading and trailing :: are one empty group as :: elsewhere, the first
+  // colon does not delimit a group and the last does not start one
+  const uint32_t leading = (mask & 3llu) == 3llu;
+  const uint32_t trailing = size >= 2 && ((mask >> (size - 2)) & 3llu) == 3llu;
+  const uint64_t delimiters = (colons | delimiter) & ~(uint64_t)leading;
+  const uint64_t groups = count_ones(delimiters) - trailing;
+
+  // a group contains at most four digits
+  uint64_t runs = hex_digits & (hex_digits >> 1);
+  runs &= runs >> 2;
+  runs &= hex_digits >> 4;
+  if ((runs & (delimiter - 1llu)) || groups > 8)
+    return 0u;
+
+  // positions of delimiters, the position before the first group is -1, or
+  // the leading colon
+  const __m512i positions = _mm512_maskz_compress_epi8(
+    delimiters, _mm512_load_si512((const void *)iota));
+  const __m512i group = _mm512_load_si512((const void *)groups_by_nibble);
+  const __m512i offset = _mm512_load_si512((const void *)offsets_by_nibble);
+
+  const __m512i end = _mm512_permutexvar_epi8(group, positions);
+  const __m512i start = _mm512_mask_permutexvar_epi8(
+    _mm512_set1_epi8((char)((int)leading - 1)), 0xfffffff0llu,
+    _mm512_sub_epi8(group, _mm512_set1_epi8(1)), positions);
+  const __m512i index = _mm512_add_epi8(end, offset);
+  const __mmask64 valid =
+    _mm512_cmpgt_epi8_mask(index, start) & 0xffffffffllu;
+
+  __m512i output = _mm512_maskz_permutexvar_epi8(valid, index, nibbles);
+  output = _mm512_maddubs_epi16(output, _mm512_set1_epi16(0x0110));
+  __m128i address = _mm256_castsi256_si128(_mm512_cvtepi16_epi8(output));
+
+  uint32_t bytes = (uint32_t)groups * 2u;
+  assert(size <= INET6_ADDRSTRLEN);
+
+  // embedded IPv4 address, the last group is actually the first octet
+  if (unlikely(src[size] == '.')) {
+    if (!mask)
+      return 0u;
+    uint32_t octets, length;
+    const uint32_t start = (uint32_t)(64u - leading_zeros(mask));
+    if (!(length = parse_dotted_quad(
+          _mm_loadu_si128((const __m128i *)(src + start)), 0, &octets)))
+      return 0u;
+    bytes -= 2u;
+    address = _mm_mask_permutexvar_epi8(
+      address, (__mmask16)(0xfu << bytes),
+      _mm_sub_epi8(_mm_load_si128((const __m128i *)iota), _mm_set1_epi8(bytes)),
+      _mm_cvtsi32_si128((int32_t)octets));
+    bytes += 4u;
+    size = start + length;
+    // a hex digit directly following the quad is not a delimiter
+    if (unlikely((uint8_t)((src[size] | 0x20) - 'a') < 6u))
+      return 0u;
+  }
+
+  if (unlikely(src[size] == ':' || src[size] == '.'))
+    return 0u;
+
+  // a trailing empty group must be part of ::, abcd:: is allowed, abcd: is not
+  const uint64_t last = (1llu << size) >> 1;
+  if (unlikely((mask & last) && !(mask & (last >> 1))))
+    return 0u;
+
+  uint64_t compressed = (mask << 1) & mask;
+  if (compressed) {
+    // :: takes the place of one or more groups (RFC 4291), the empty group
+    // is included in bytes
+    if ((count_ones(compressed) > 1) || (bytes > 16))
+      return 0u;
+    // move groups that follow :: to the end, zero the groups in between
+    const uint64_t group = count_ones(mask & (compressed - 1)) - leading;
+    const __m128i expansion =
+      _mm_load_si128((const __m128i *)expansions[group][bytes >> 1]);
+    address = _mm_shuffle_epi8(address, expansion);
+    bytes = 16;
+  }
+
+  if (bytes != 16)
+    return 0u;
+
+  _mm_storeu_si128((__m128i *)dst, address);
+  return size;
+}
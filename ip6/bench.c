@@ -0,0 +1,1135 @@
+/*
+ * bench.c -- benchmark IPv6 and IPv4 parsers and formatter
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "ip6.h"
+#include "benchmark.h"
+#include "corpus.h"
+#include "latency.h"
+
+typedef struct address address_t;
+struct address { char text[128]; size_t length; uint8_t octets[16]; };
+
+static const char digits[] = "0123456789abcdef";
+
+// generate an address, groups are full length if width is set. a run of at
+// least two zero groups is compressed if compress is set
+static void generate(address_t *address, size_t width, bool compress)
+{
+  size_t start = 8, end = 8;
+  if (compress) {
+    start = random() % 7;
+    end = start + 2 + random() % (7 - start);
+  }
+
+  size_t length = 0;
+  for (size_t group = 0; group < 8; group++) {
+    uint16_t value = 0;
+    if (group >= start && group < end) {
+      if (group == start && group == 0)
+        address->text[length++] = ':';
+      if (group == start)
+        address->text[length++] = ':';
+    } else {
+      size_t count = width ? width : 1 + (size_t)(random() % 4);
+      for (size_t i = 0; i < count; i++) {
+        const uint8_t digit = random() % 16;
+        value = (uint16_t)((value << 4) | digit);
+        address->text[length++] = digits[digit];
+      }
+      address->text[length++] = ':';
+    }
+    address->octets[2*group] = (uint8_t)(value >> 8);
+    address->octets[2*group + 1] = (uint8_t)value;
+  }
+  if (start == 8 || end != 8)
+    length--;
+  address->text[length] = '\0';
+  address->length = length;
+}
+
+// generate an IPv4-mapped (::ffff:0:0/96) or NAT64 (64:ff9b::/96) address
+static void generate_embedded(address_t *address)
+{
+  static const struct { const char *text; uint8_t octets[12]; } prefixes[] = {
+    { "::ffff:", { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff } },
+    { "64:ff9b::", { 0, 0x64, 0xff, 0x9b, 0, 0, 0, 0, 0, 0, 0, 0 } }
+  };
+
+  const size_t prefix = random() % 2;
+  uint8_t octets[4];
+  for (size_t i = 0; i < 4; i++)
+    octets[i] = (uint8_t)random();
+  int length = snprintf(address->text, sizeof(address->text), "%s%u.%u.%u.%u",
+    prefixes[prefix].text, octets[0], octets[1], octets[2], octets[3]);
+  address->length = (size_t)length;
+  memcpy(address->octets, prefixes[prefix].octets, 12);
+  memcpy(address->octets + 12, octets, 4);
+}
+
+// generate a dotted quad, octets are zero to three digits
+static void generate_quad(address_t *address)
+{
+  static const uint32_t limits[3] = { 10, 100, 256 };
+  uint8_t octets[4];
+  for (size_t i = 0; i < 4; i++)
+    octets[i] = (uint8_t)(random() % limits[random() % 3]);
+  int length = snprintf(address->text, sizeof(address->text), "%u.%u.%u.%u",
+    octets[0], octets[1], octets[2], octets[3]);
+  address->length = (size_t)length;
+  memset(address->octets, 0, 16);
+  memcpy(address->octets, octets, 4);
+}
+
+// append a prefix length of zero to three digits to a generated address
+static void generate_prefix(address_t *address, uint8_t *prefix)
+{
+  generate(address, 0, random() % 2);
+  *prefix = (uint8_t)(random() % 129);
+  address->length += (size_t)snprintf(address->text + address->length,
+    sizeof(address->text) - address->length, "/%u", *prefix);
+}
+
+// generate a route of 16 to 64 bits in 2000::/3 as text, most routes are
+// /32 or /48 as in a global routing table. bits past the prefix are zero
+static void generate_route(address_t *address, uint8_t *prefix)
+{
+  static const uint8_t lengths[] =
+    { 16, 20, 24, 28, 29, 32, 32, 32, 36, 40, 44, 48, 48, 48, 48, 48, 56, 64 };
+  *prefix = lengths[random() % sizeof(lengths)];
+  for (size_t i = 0; i < 16; i++)
+    address->octets[i] = i < (size_t)(*prefix + 7) / 8 ? (uint8_t)random() : 0;
+  address->octets[0] = 0x20 | (address->octets[0] & 0x1f);
+  if (*prefix % 8)
+    address->octets[*prefix / 8] &= (uint8_t)(0xff00u >> (*prefix % 8));
+  inet_ntop(AF_INET6, address->octets, address->text, sizeof(address->text));
+  address->length = strlen(address->text);
+  address->length += (size_t)snprintf(address->text + address->length,
+    sizeof(address->text) - address->length, "/%u", *prefix);
+}
+
+// generate log lines, every other with an address. times, MAC addresses,
+// IPv4 addresses, version numbers and qualified names must not match
+static char *generate_log(
+  size_t lines, address_t *expected, size_t *count, size_t *len)
+{
+  char *log;
+  if (!(log = malloc(lines * 160)))
+    return NULL;
+
+  static const char *formats[] = {
+    "sshd[%u]: Accepted publickey for root from %s port %u ssh2\n",
+    "kernel: eth%u: link up, mac 00:1a:2b:%02x:4d:5e, speed 1000\n",
+    "resolver: query [%s]:%u from std::vector v1.2.%u\n",
+    "nginx: 10.1.2.%u - - [01/Mar/2025:12:34:56 +0000] \"GET / HTTP/1.1\" 200\n",
+    "dhcp6: lease renewed for %s.\n"
+  };
+
+  *count = 0;
+  *len = 0;
+  for (size_t i = 0; i < lines; i++) {
+    const size_t format = random() % 5;
+    char *line = log + *len;
+    *len += (size_t)sprintf(line, "2025-03-01T12:%02u:%02u.%03uZ host ",
+      (uint32_t)random() % 60, (uint32_t)random() % 60, (uint32_t)random() % 1000);
+    address_t *address = &expected[*count];
+    if (format % 2 == 0)
+      generate(address, 0, random() % 2);
+    const uint32_t number = (uint32_t)random() % 256;
+    switch (format) {
+      case 0:
+        *len += (size_t)sprintf(log + *len, formats[0], number, address->text, number);
+        break;
+      case 2:
+        *len += (size_t)sprintf(log + *len, formats[2], address->text, number, number);
+        break;
+      case 4:
+        *len += (size_t)sprintf(log + *len, formats[4], address->text);
+        break;
+      default:
+        *len += (size_t)sprintf(log + *len, formats[format], number);
+        break;
+    }
+    if (format % 2 == 0)
+      (*count)++;
+  }
+
+  return log;
+}
+
+#define error(message) (void)(printf(message "\n")), exit(EXIT_FAILURE)
+
+static bool avx512 = false;
+
+// compare engines against the generated address
+static void verify(const address_t *test_data, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    uint8_t addr0[32], addr1[32], addr2[32], addr3[32];
+    size_t length0 = parse_ip6_sse41(test_data[i].text, addr0);
+    size_t length1 = parse_ip6_avx2(test_data[i].text, addr1);
+    size_t length2 = length0;
+    if (avx512)
+      length2 = parse_ip6_avx512(test_data[i].text, addr2);
+    else
+      memcpy(addr2, addr0, 16);
+    size_t length3 = parse_ip6_scalar(test_data[i].text, addr3);
+    if (length0 != test_data[i].length || length1 != length0 ||
+        length2 != length0 || length3 != length0 ||
+        memcmp(addr0, test_data[i].octets, 16) != 0 ||
+        memcmp(addr0, addr1, 16) != 0 || memcmp(addr0, addr2, 16) != 0 ||
+        memcmp(addr0, addr3, 16) != 0)
+    {
+      printf("mismatch for %s\n", test_data[i].text);
+      exit(EXIT_FAILURE);
+    }
+
+    // formatted text must match inet_ntop, which writes addresses that
+    // embed an IPv4 address in ::/96 as ::a.b.c.d (RFC 5952 does not)
+    char text[IP6_PADDING], expect[INET6_ADDRSTRLEN];
+    static const uint8_t compatible[12] = { 0 };
+    size_t length = format_ip6(test_data[i].octets, text);
+    inet_ntop(AF_INET6, test_data[i].octets, expect, sizeof(expect));
+    if (length != strlen(text) ||
+        (strcmp(text, expect) != 0 &&
+         memcmp(test_data[i].octets, compatible, 12) != 0) ||
+        parse_ip6(text, addr0) != length ||
+        memcmp(addr0, test_data[i].octets, 16) != 0)
+    {
+      printf("mismatch for %s (formatted as %s)\n", test_data[i].text, text);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// compare format_ip6_batch against inet_ntop line by line. addresses in
+// ::/96 are compared against format_ip6 instead, as in verify
+static void verify_format_batch(const address_t *test_data, size_t count)
+{
+  static const uint8_t compatible[12] = { 0 };
+  uint8_t (*octets)[16];
+  char *output;
+  if (!(octets = calloc(count, sizeof(*octets))) ||
+      !(output = malloc(count * 40 + IP6_PADDING)))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < count; i++)
+    memcpy(octets[i], test_data[i].octets, 16);
+
+  const size_t size = format_ip6_batch(octets, count, output);
+  const char *line = output, *end = output + size;
+  for (size_t i = 0; i < count; i++) {
+    char expect[IP6_PADDING];
+    const char *newline = memchr(line, '\n', (size_t)(end - line));
+    if (memcmp(octets[i], compatible, 12) == 0)
+      format_ip6(octets[i], expect);
+    else
+      inet_ntop(AF_INET6, octets[i], expect, sizeof(expect));
+    if (!newline || (size_t)(newline - line) != strlen(expect) ||
+        memcmp(line, expect, strlen(expect)) != 0)
+    {
+      printf("mismatch for %s (formatted in batch)\n", expect);
+      exit(EXIT_FAILURE);
+    }
+    line = newline + 1;
+  }
+  if (line != end)
+    error("mismatch in length of formatted batch");
+
+  free(output);
+  free(octets);
+}
+
+// compare parse_ip6_prefix against the generated prefixes and reject
+// malformed prefix lengths
+static void verify_prefixes(
+  const address_t *test_data, const uint8_t *prefixes, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    uint8_t addr[32], prefix = 0;
+    size_t length = parse_ip6_prefix(test_data[i].text, addr, &prefix);
+    if (length != test_data[i].length || prefix != prefixes[i] ||
+        memcmp(addr, test_data[i].octets, 16) != 0)
+    {
+      printf("mismatch for %s\n", test_data[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  static const struct { const char *text; size_t length; uint8_t prefix; } tests[] = {
+    { "2001:db8::/32", 13, 32 },
+    { "::/0", 4, 0 },
+    { "::ffff:1.2.3.4/128 ", 18, 128 },
+    { "0123:4567:89ab:cdef:0123:4567:89ab:cdef/64", 42, 64 },
+    { "2001:db8::", 0, 0 },
+    { "2001:db8::/", 0, 0 },
+    { "2001:db8::/129", 0, 0 },
+    { "2001:db8::/032", 0, 0 },
+    { "2001:db8::/00", 0, 0 },
+    { "2001:db8::/1280", 0, 0 },
+    { "2001:db8::/32a", 0, 0 },
+    { "2001:db8::/32:", 0, 0 },
+    { "2001:db8::/32.", 0, 0 },
+    { "2001:db8::/32/", 0, 0 },
+    { "2001:db8::/-1", 0, 0 }
+  };
+
+  for (size_t i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+    char text[IP6_PADDING] = { 0 };
+    uint8_t addr[32], prefix = 0;
+    strcpy(text, tests[i].text);
+    size_t length = parse_ip6_prefix(text, addr, &prefix);
+    if (length != tests[i].length || (length && prefix != tests[i].prefix)) {
+      printf("mismatch for %s\n", tests[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// compare parse_ip6_bounded against parse_ip6 with the address placed right
+// before an inaccessible page
+static void verify_bounded(const address_t *test_data, size_t count)
+{
+  const long page = sysconf(_SC_PAGESIZE);
+  char *pages = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pages == MAP_FAILED || mprotect(pages + page, page, PROT_NONE) != 0)
+    error("failed to map guard page");
+
+  for (size_t i = 0; i < count; i++) {
+    uint8_t addr0[32], addr1[32];
+    const size_t length = test_data[i].length;
+    char *text = pages + page - length;
+    memcpy(text, test_data[i].text, length);
+    size_t length0 = parse_ip6_sse41(test_data[i].text, addr0);
+    size_t length1 = parse_ip6_bounded(text, length, addr1);
+    if (length1 != length0 || memcmp(addr0, addr1, 16) != 0) {
+      printf("mismatch for %s (bounded)\n", test_data[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  munmap(pages, 2 * page);
+}
+
+// compare engines against inet_pton on every layout of up to nine groups of
+// zero to five digits, which includes invalid layouts
+static void verify_layouts(void)
+{
+  size_t count = 0;
+  for (size_t groups = 1; groups <= 9; groups++) {
+    uint8_t widths[9] = { 0 };
+    for (;;) {
+      char text[128] = { 0 };
+      size_t length = 0;
+      for (size_t group = 0; group < groups; group++) {
+        for (size_t i = 0; i < widths[group]; i++)
+          text[length++] = "0123456789abcdefABCDEF"[random() % 22];
+        text[length++] = ':';
+      }
+      text[--length] = '\0';
+
+      uint8_t addr0[32], addr1[32], addr2[32], addr3[32], expect[16];
+      const size_t expected =
+        inet_pton(AF_INET6, text, expect) == 1 ? length : 0;
+      size_t length0 = parse_ip6_sse41(text, addr0);
+      size_t length1 = parse_ip6_avx2(text, addr1);
+      size_t length2 = avx512 ? parse_ip6_avx512(text, addr2) : length0;
+      size_t length3 = parse_ip6_scalar(text, addr3);
+      if (length0 != expected || length1 != expected ||
+          length2 != expected || length3 != expected ||
+          (expected && memcmp(addr0, expect, 16) != 0) ||
+          (expected && memcmp(addr1, expect, 16) != 0) ||
+          (expected && avx512 && memcmp(addr2, expect, 16) != 0) ||
+          (expected && memcmp(addr3, expect, 16) != 0))
+      {
+        printf("mismatch for %s\n", text);
+        exit(EXIT_FAILURE);
+      }
+      count++;
+
+      size_t group = 0;
+      for (; group < groups && widths[group] == 5; group++)
+        widths[group] = 0;
+      if (group == groups)
+        break;
+      widths[group]++;
+    }
+  }
+  printf("verified %zu layouts\n", count);
+}
+
+// join addresses into records separated by whitespace, every other record
+// is made invalid by a trailing colon or letter. the last record ends at len
+// and is followed by the padding parse_ip6_batch requires
+static char *join(
+  const address_t *test_data, size_t count, size_t *offsets, size_t *len)
+{
+  static const char *separators[] = { " ", "\n", "\t ", "\r\n" };
+  char *text;
+  if (!(text = malloc(count * (sizeof(test_data->text) + 2) + IP6_PADDING)))
+    return NULL;
+
+  *len = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (i)
+      *len += (size_t)sprintf(text + *len, "%s", separators[i % 4]);
+    offsets[i] = *len;
+    memcpy(text + *len, test_data[i].text, test_data[i].length);
+    *len += test_data[i].length;
+    if (i % 4 == 1)
+      text[(*len)++] = ':';
+    else if (i % 4 == 3)
+      text[(*len)++] = 'g';
+  }
+  memset(text + *len, 0, IP6_PADDING);
+  return text;
+}
+
+// split text into records and parse each with parse_ip6, as a caller would
+// without parse_ip6_batch
+static size_t parse_records(
+  const char *text, size_t len, uint8_t (*octets)[16], uint8_t *status)
+{
+  const char *cursor = text, *end = text + len;
+  size_t records = 0;
+  while ((cursor += strspn(cursor, " \t\r\n")) < end) {
+    const size_t length = strcspn(cursor, " \t\r\n");
+    const size_t size = parse_ip6(cursor, octets[records]);
+    status[records++] = size == length ? (uint8_t)size : 0u;
+    cursor += length;
+  }
+  return records;
+}
+
+// compare parse_ip6_batch against parse_ip6 record by record and measure
+// both
+static void run_batch(const address_t *test_data, size_t count)
+{
+  char *text;
+  size_t *offsets, len;
+  uint8_t (*octets)[16], *status;
+  if (!(offsets = calloc(count, sizeof(*offsets))) ||
+      !(octets = calloc(count, sizeof(*octets))) ||
+      !(status = calloc(count, sizeof(*status))) ||
+      !(text = join(test_data, count, offsets, &len)))
+    error("failed to allocate memory");
+
+  size_t consumed;
+  if (parse_ip6_batch(text, len, octets, status, count, &consumed) != count ||
+      consumed != len)
+    error("mismatch in number of records (batch)");
+  for (size_t i = 0; i < count; i++) {
+    char record[IP6_PADDING] = { 0 };
+    uint8_t addr[32];
+    const size_t length = strcspn(text + offsets[i], " \t\r\n");
+    memcpy(record, text + offsets[i], length);
+    const size_t expected = parse_ip6(record, addr) == length ? length : 0;
+    if (status[i] != expected || (expected && memcmp(addr, octets[i], 16) != 0)) {
+      printf("mismatch for %s (batch)\n", record);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // the last record ends exactly at len at every offset into a block
+  for (size_t pad = 0; pad < 16; pad++) {
+    char records[64] = { 0 };
+    uint8_t addr[3][16], lengths[3];
+    memset(records, ' ', pad);
+    strcpy(records + pad, "2001:db8::1 1:2:3:4:5:6:7:8:9 1::");
+    if (parse_ip6_batch(records, strlen(records), addr, lengths, 3, &consumed) != 3 ||
+        consumed != strlen(records) ||
+        lengths[0] != 11 || lengths[1] != 0 || lengths[2] != 3 ||
+        memcmp(addr[2], "\0\1\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16) != 0)
+      error("mismatch for records ending at len (batch)");
+  }
+
+  // parsing that stops at count resumes from the offset it returns
+  for (size_t i = 0, offset = 0; i < count; ) {
+    uint8_t resumed[7][16], lengths[7];
+    const size_t records = parse_ip6_batch(
+      text + offset, len - offset, resumed, lengths, 7, &consumed);
+    if (!records || records > count - i)
+      error("mismatch in number of records (resumed batch)");
+    for (size_t j = 0; j < records; j++, i++)
+      if (lengths[j] != status[i] ||
+          (status[i] && memcmp(resumed[j], octets[i], 16) != 0))
+        error("mismatch for resumed records (batch)");
+    offset += consumed;
+    if (i == count && offset != len)
+      error("mismatch in consumed length (batch)");
+  }
+
+  BEST_TIME(/**/,
+    parse_ip6_batch(text, len, octets, status, count, &consumed),
+    "parse_ip6_batch", 5, count);
+  BEST_TIME(/**/,
+    parse_records(text, len, octets, status),
+    "parse_ip6 (per record)", 5, count);
+
+  free(text);
+  free(status);
+  free(octets);
+  free(offsets);
+}
+
+// compare engines against inet_pton on addresses in which :: takes the place
+// of a single group (RFC 4291), and on the same layouts with a group too many
+static void verify_compressed(void)
+{
+  static const struct { const char *text; size_t length; } tests[] = {
+    { "1:2:3:4:5:6::7", 14 },
+    { "1::3:4:5:6:7:8", 14 },
+    { "::2222:3333:4444:5555:6666:7777:8888", 36 },
+    { "1:2:3:4:5:6:7::", 15 },
+    { "1:2:3:4:5::1.2.3.4", 18 },
+    { "::2:3:4:5:6:1.2.3.4", 19 },
+    { "1:2:3:4:5:6:7::8", 0 },
+    { "::1:2:3:4:5:6:7:8", 0 },
+    { "1:2:3:4:5:6:7:8::", 0 },
+    { "1:2:3:4:5:6::1.2.3.4", 0 },
+    { "1:2:3:4:5:6:7:::", 0 }
+  };
+
+  for (size_t i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+    char text[IP6_PADDING] = { 0 };
+    uint8_t addr0[32], addr1[32], addr2[32], addr3[32], addr4[32], expect[16];
+    strcpy(text, tests[i].text);
+    const size_t length = tests[i].length;
+    size_t length0 = parse_ip6_sse41(text, addr0);
+    size_t length1 = parse_ip6_avx2(text, addr1);
+    size_t length2 = avx512 ? parse_ip6_avx512(text, addr2) : length0;
+    size_t length3 = parse_ip6_scalar(text, addr3);
+    size_t length4 = parse_ip6_bounded(text, strlen(text), addr4);
+    if ((inet_pton(AF_INET6, text, expect) == 1) != (length != 0) ||
+        length0 != length || length1 != length || length2 != length ||
+        length3 != length || length4 != length ||
+        (length && memcmp(addr0, expect, 16) != 0) ||
+        (length && memcmp(addr1, expect, 16) != 0) ||
+        (length && avx512 && memcmp(addr2, expect, 16) != 0) ||
+        (length && memcmp(addr3, expect, 16) != 0) ||
+        (length && memcmp(addr4, expect, 16) != 0))
+    {
+      printf("mismatch for %s\n", tests[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+typedef size_t (*parser_t)(const char *, void *);
+
+static size_t parse_inet_pton(const char *src, void *dst)
+{
+  return inet_pton(AF_INET6, src, dst) == 1;
+}
+
+static const struct {
+  const char *name; parser_t parse; bool avx512;
+} engines[] = {
+  { "parse_ip6", parse_ip6, false },
+  { "parse_ip6_sse41", parse_ip6_sse41, false },
+  { "parse_ip6_avx2", parse_ip6_avx2, false },
+  { "parse_ip6_avx512", parse_ip6_avx512, true },
+  { "parse_ip6_scalar", parse_ip6_scalar, false },
+  { "inet_pton", parse_inet_pton, false }
+};
+
+#define ENGINES (sizeof(engines)/sizeof(engines[0]))
+
+// best of several passes over all addresses. cycles are measured with the
+// time-stamp counter, which runs at a constant rate
+static void measure(
+  parser_t parse, const char (*texts)[64], size_t count, double *cycles, double *rate)
+{
+  uint8_t address[32];
+  uint64_t best_cycles = UINT64_MAX;
+  double best_seconds = 0.0;
+
+  for (size_t pass = 0; pass < 5; pass++) {
+    struct timespec start, end;
+    uint64_t cycles_start, cycles_final;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RDTSC_START(cycles_start);
+    for (size_t i = 0; i < count; i++)
+      parse(texts[i], address);
+    RDTSC_STOP(cycles_final);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds =
+      (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (cycles_final - cycles_start < best_cycles) {
+      best_cycles = cycles_final - cycles_start;
+      best_seconds = seconds;
+    }
+  }
+
+  *cycles = (double)best_cycles / (double)count;
+  *rate = (double)count / best_seconds;
+}
+
+typedef struct sample sample_t;
+struct sample { char layout[16]; const char *text; };
+
+// describe the layout by the number of groups before and after ::, an
+// embedded IPv4 address is not counted as a group
+static void describe(const char *text, size_t length, char layout[16])
+{
+  size_t groups[2] = { 0, 0 }, compressed = 0;
+  const bool quad = memchr(text, '.', length) != NULL;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == ':' && text[i + 1] == ':')
+      compressed = 1;
+    else if (text[i] != ':' && text[i] != '.' && (!i || text[i - 1] == ':'))
+      groups[compressed]++;
+  }
+  groups[compressed] -= quad;
+  if (compressed)
+    snprintf(layout, 16, "%zu::%zu%s", groups[0], groups[1], quad ? "+v4" : "");
+  else
+    snprintf(layout, 16, "%zu%s", groups[0], quad ? "+v4" : "");
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+  return strcmp(((const sample_t *)a)->layout, ((const sample_t *)b)->layout);
+}
+
+// report cycles per address for each engine over the corpus and for each
+// layout within it, so that regressions for particular layouts show up.
+// addresses are copied to consecutive slots so that layouts are measured
+// under the same (sequential) memory access pattern
+static void report(const address_t *test_data, size_t count)
+{
+  sample_t *samples;
+  char (*texts)[64];
+  if (!(samples = calloc(count, sizeof(*samples))) ||
+      !(texts = calloc(count + 1, sizeof(*texts))))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < count; i++) {
+    describe(test_data[i].text, test_data[i].length, samples[i].layout);
+    samples[i].text = test_data[i].text;
+  }
+  qsort(samples, count, sizeof(*samples), compare_samples);
+
+  printf("%-14s %9s", "layout", "count");
+  for (size_t engine = 0; engine < ENGINES; engine++)
+    if (avx512 || !engines[engine].avx512)
+      printf(" %17s", engines[engine].name);
+  printf("\n");
+
+  double rates[ENGINES], cycles[ENGINES];
+  for (size_t first = 0, last; first <= count; first = last) {
+    const char *layout = first < count ? samples[first].layout : "all";
+    size_t size = count;
+    if (first < count) {
+      for (last = first; last < count && strcmp(samples[last].layout, layout) == 0; last++)
+        ;
+      size = last - first;
+      for (size_t i = 0; i < size; i++)
+        memcpy(texts[i], samples[first + i].text, sizeof(texts[i]));
+    } else {
+      last = count + 1;
+      for (size_t i = 0; i < count; i++)
+        memcpy(texts[i], test_data[i].text, sizeof(texts[i]));
+    }
+
+    printf("%-14s %9zu", layout, size);
+    for (size_t engine = 0; engine < ENGINES; engine++) {
+      if (!avx512 && engines[engine].avx512)
+        continue;
+      measure(engines[engine].parse, texts, size, &cycles[engine], &rates[engine]);
+      printf(" %17.1f", cycles[engine]);
+    }
+    printf("\n");
+  }
+
+  printf("%-14s %9s", "addresses/s", "");
+  for (size_t engine = 0; engine < ENGINES; engine++)
+    if (avx512 || !engines[engine].avx512)
+      printf(" %16.1fM", rates[engine] / 1e6);
+  printf("\n");
+
+
+  // parse_ip6 is bound to an engine at load time, calling it costs no more
+  // than calling the engine directly (both are in the first column)
+  char name[32];
+  snprintf(name, sizeof(name), "parse_ip6_%s", parse_ip6_engine());
+  for (size_t engine = 1; engine < ENGINES; engine++)
+    if (strcmp(engines[engine].name, name) == 0)
+      printf("parse_ip6 dispatches to %s, overhead %.1f cycles/address\n",
+        name, cycles[0] - cycles[engine]);
+
+  free(texts);
+  free(samples);
+}
+
+// best of several passes over the text
+static void measure_scan(
+  const char *text, size_t len, ip6_match_t *matches, size_t count, const char *name)
+{
+  double best = 0.0;
+  size_t found = 0;
+  for (size_t pass = 0; pass < 5; pass++) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    found = scan_ip6(text, len, matches, count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds =
+      (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (!pass || seconds < best)
+      best = seconds;
+  }
+  printf("%-30s\t: %zu addresses in %zu bytes, %.2f GB/s\n",
+    name, found, len, (double)len / best / 1e9);
+}
+
+// reverse name the way it is written today, one nibble at a time
+static size_t reverse_snprintf(const uint8_t *octets, uint32_t prefix, char *dst)
+{
+  size_t length = 0;
+  for (uint32_t nibble = prefix / 4; nibble-- > 0; ) {
+    const uint8_t octet = octets[nibble / 2];
+    length += (size_t)snprintf(dst + length, 3, "%x.",
+      nibble & 1 ? octet & 0xf : octet >> 4);
+  }
+  return length + (size_t)snprintf(dst + length, 10, "ip6.arpa.");
+}
+
+// compare reverse names against the reference for every nibble aligned
+// prefix, names in wire format must spell the same labels
+static void verify_arpa(const uint8_t (*octets)[16], size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    for (uint32_t prefix = 0; prefix <= 128; prefix += 4) {
+      char text[IP6_ARPA_SIZE], expect[IP6_ARPA_SIZE];
+      uint8_t wire[IP6_ARPA_SIZE];
+      const size_t length = format_ip6_arpa(octets[i], prefix, text);
+      const size_t wire_length = format_ip6_arpa_wire(octets[i], prefix, wire);
+      bool match = length == reverse_snprintf(octets[i], prefix, expect) &&
+                   strcmp(text, expect) == 0 && wire_length == length + 1;
+      // a length octet takes the place of each dot
+      for (size_t j = 0, label = 0; match && j < wire_length; j++) {
+        if (j == label) {
+          const char *dot = strchr(text + j, '.');
+          label = j + 1 + wire[j];
+          match = dot ? wire[j] == (size_t)(dot - (text + j)) : !wire[j];
+        } else {
+          match = wire[j] == (uint8_t)text[j - 1];
+        }
+      }
+      if (!match) {
+        printf("mismatch for reverse name %s/%u\n", expect, prefix);
+        exit(EXIT_FAILURE);
+      }
+    }
+    char text[IP6_ARPA_SIZE];
+    if (format_ip6_arpa(octets[i], 127, text) ||
+        format_ip6_arpa(octets[i], 132, text))
+      error("reverse name for invalid prefix");
+  }
+}
+
+// best of several passes over the addresses, one lookup at a time and in
+// batches
+static void measure_lpm(
+  const ip6_lpm_t *lpm, const uint8_t (*addresses)[16], size_t count, uint32_t *values)
+{
+  double best[2] = { 0.0, 0.0 };
+  for (size_t pass = 0; pass < 5; pass++) {
+    struct timespec start, middle, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++)
+      values[i] = ip6_lpm_lookup(lpm, addresses[i]);
+    clock_gettime(CLOCK_MONOTONIC, &middle);
+    ip6_lpm_lookup_batch(lpm, addresses, count, values);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds[2] = {
+      (double)(middle.tv_sec - start.tv_sec) + (middle.tv_nsec - start.tv_nsec) / 1e9,
+      (double)(end.tv_sec - middle.tv_sec) + (end.tv_nsec - middle.tv_nsec) / 1e9 };
+    for (size_t i = 0; i < 2; i++)
+      if (!pass || seconds[i] < best[i])
+        best[i] = seconds[i];
+  }
+  printf("%-30s\t: %.1fM lookups/s\n", "ip6_lpm_lookup", (double)count / best[0] / 1e6);
+  printf("%-30s\t: %.1fM lookups/s\n", "ip6_lpm_lookup_batch", (double)count / best[1] / 1e6);
+}
+
+static void run(const address_t *test_data, size_t count)
+{
+  uint8_t addr[32];
+  char text[IP6_PADDING];
+
+  verify(test_data, count);
+  verify_bounded(test_data, count);
+  verify_format_batch(test_data, count);
+
+  BEST_TIME(/**/,
+    parse_ip6(test_data[i].text, addr),
+    "parse_ip6", count, 1);
+  BEST_TIME(/**/,
+    parse_ip6_sse41(test_data[i].text, addr),
+    "parse_ip6_sse41", count, 1);
+  BEST_TIME(/**/,
+    parse_ip6_bounded(test_data[i].text, test_data[i].length, addr),
+    "parse_ip6_bounded", count, 1);
+  BEST_TIME(/**/,
+    parse_ip6_avx2(test_data[i].text, addr),
+    "parse_ip6_avx2", count, 1);
+  if (avx512)
+    BEST_TIME(/**/,
+      parse_ip6_avx512(test_data[i].text, addr),
+      "parse_ip6_avx512", count, 1);
+  BEST_TIME(/**/,
+    parse_ip6_scalar(test_data[i].text, addr),
+    "parse_ip6_scalar", count, 1);
+  BEST_TIME(/**/,
+    inet_pton(AF_INET6, test_data[i].text, addr),
+    "inet_pton", count, 1);
+  BEST_TIME(/**/,
+    format_ip6(test_data[i].octets, text),
+    "format_ip6", count, 1);
+  BEST_TIME(/**/,
+    inet_ntop(AF_INET6, test_data[i].octets, text, sizeof(text)),
+    "inet_ntop", count, 1);
+
+  run_batch(test_data, count);
+  measure_patterns(test_data[0].text, sizeof(address_t), count);
+  report(test_data, count);
+}
+
+// map a corpus generated by perm. records are verified against the octets
+// they carry, nothing is skipped
+static address_t *load_corpus(const char *path, size_t *count)
+{
+  int fd;
+  struct stat st;
+  if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) != 0)
+    error("cannot open corpus");
+
+  const size_t size = (size_t)st.st_size;
+  const corpus_header_t *header;
+  if ((header = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    error("cannot map corpus");
+  close(fd);
+
+  if (header->version != CORPUS_VERSION ||
+      header->record_size != sizeof(corpus_record_t) ||
+      size != sizeof(*header) + header->count * sizeof(corpus_record_t) + CORPUS_PADDING)
+    error("corpus is corrupt or of a different version");
+
+  const corpus_record_t *records = (const corpus_record_t *)(header + 1);
+  address_t *addresses;
+  *count = header->count;
+  if (!(addresses = calloc(*count ? *count : 1, sizeof(*addresses))))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < *count; i++) {
+    const size_t length = strnlen(records[i].text, sizeof(records[i].text));
+    memcpy(addresses[i].text, records[i].text, length);
+    addresses[i].length = length;
+    memcpy(addresses[i].octets, records[i].octets, 16);
+  }
+
+  munmap((void *)header, size);
+  printf("loaded %zu addresses from %s\n", *count, path);
+  return addresses;
+}
+
+// read addresses, one per line, from a dump of real-world addresses.
+// addresses inet_pton rejects are skipped
+static address_t *load(const char *path, size_t *count)
+{
+  FILE *file;
+  if (!(file = fopen(path, "r")))
+    error("cannot open address dump");
+
+  char magic[sizeof(CORPUS_MAGIC)];
+  if (fread(magic, sizeof(magic), 1, file) == 1 &&
+      memcmp(magic, CORPUS_MAGIC, sizeof(magic)) == 0)
+  {
+    fclose(file);
+    return load_corpus(path, count);
+  }
+  rewind(file);
+
+  address_t *addresses = NULL;
+  size_t size = 0, skipped = 0;
+  char *line = NULL;
+  size_t capacity = 0;
+  *count = 0;
+  while (getline(&line, &capacity, file) != -1) {
+    size_t length = strcspn(line, " \t\r\n#");
+    if (!length)
+      continue;
+    if (*count == size) {
+      size = size ? 2 * size : 4096;
+      if (!(addresses = realloc(addresses, size * sizeof(*addresses))))
+        error("failed to allocate memory");
+    }
+    address_t *address = &addresses[*count];
+    memset(address, 0, sizeof(*address));
+    if (length >= INET6_ADDRSTRLEN)
+      length = INET6_ADDRSTRLEN - 1;
+    memcpy(address->text, line, length);
+    address->length = length;
+    if (inet_pton(AF_INET6, address->text, address->octets) != 1)
+      skipped++;
+    else
+      (*count)++;
+  }
+
+  free(line);
+  fclose(file);
+  printf("loaded %zu addresses from %s, skipped %zu\n", *count, path, skipped);
+  return addresses;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [DUMP | CORPUS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  size_t count = 2000000ull;
+
+  address_t *test_data;
+
+  if (!(test_data = calloc(sizeof(address_t), count)))
+    error("failed to allocate memory");
+
+  pid_t pid = getpid();
+  srandom(pid);
+
+  avx512 = strcmp(parse_ip6_engine(), "avx512") == 0;
+  if (!avx512)
+    printf("no support for avx512, run under Intel SDE to include it\n");
+
+  verify_layouts();
+  verify_compressed();
+
+  uint8_t addr[32];
+
+  static const struct {
+    const char *name; size_t width; bool compress; bool embed;
+  } corpora[] = {
+    { "random", 0, false, false },
+    { "full-form", 4, false, false },
+    { "compressed", 0, true, false },
+    { "embedded", 0, false, true }
+  };
+
+  for (size_t corpus = 0; corpus < sizeof(corpora)/sizeof(corpora[0]); corpus++) {
+    printf("generating test data (%s)\n", corpora[corpus].name);
+    for (size_t i = 0; i < count; i++) {
+      if (corpora[corpus].embed)
+        generate_embedded(&test_data[i]);
+      else
+        generate(&test_data[i], corpora[corpus].width, corpora[corpus].compress);
+    }
+    run(test_data, count);
+  }
+
+  if (argc == 2) {
+    size_t size;
+    address_t *dump = load(argv[1], &size);
+    if (size) {
+      printf("addresses from %s\n", argv[1]);
+      run(dump, size);
+    }
+    free(dump);
+  }
+
+  // formatting addresses in bulk
+  uint8_t (*octets)[16];
+  char *output;
+  if (!(octets = calloc(16, count)) || !(output = malloc(count * 40 + IP6_PADDING)))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < count; i++)
+    memcpy(octets[i], test_data[i].octets, 16);
+  BEST_TIME(/**/,
+    format_ip6_batch(octets, count, output),
+    "format_ip6_batch", 1, count);
+  free(output);
+
+  // reverse names, one at a time and in bulk
+  char name[IP6_ARPA_SIZE];
+  if (!(output = malloc(count * IP6_ARPA_SIZE)))
+    error("failed to allocate memory");
+  // fault the pages in before the first pass
+  memset(output, 0, count * IP6_ARPA_SIZE);
+  verify_arpa(octets, count);
+  BEST_TIME(/**/,
+    format_ip6_arpa(octets[i], 128, name),
+    "format_ip6_arpa", count, 1);
+  BEST_TIME(/**/,
+    format_ip6_arpa(octets[i], 48, name),
+    "format_ip6_arpa (/48)", count, 1);
+  BEST_TIME(/**/,
+    format_ip6_arpa_wire(octets[i], 128, (uint8_t *)name),
+    "format_ip6_arpa_wire", count, 1);
+  BEST_TIME(/**/,
+    reverse_snprintf(octets[i], 128, name),
+    "snprintf", count, 1);
+  BEST_TIME(/**/,
+    format_ip6_arpa_batch(octets, count, 128, output),
+    "format_ip6_arpa_batch", 1, count);
+  BEST_TIME(/**/,
+    format_ip6_arpa_wire_batch(octets, count, 128, (uint8_t *)output),
+    "format_ip6_arpa_wire_batch", 1, count);
+  free(output);
+  free(octets);
+
+  printf("generating test data (prefixes)\n");
+  uint8_t *prefixes;
+  if (!(prefixes = malloc(count)))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < count; i++)
+    generate_prefix(&test_data[i], &prefixes[i]);
+  verify_prefixes(test_data, prefixes, count);
+
+  uint8_t prefix;
+  BEST_TIME(/**/,
+    parse_ip6_prefix(test_data[i].text, addr, &prefix),
+    "parse_ip6_prefix", count, 1);
+  free(prefixes);
+
+  printf("generating test data (logs)\n");
+  size_t lines = count / 4, expected, len;
+  char *log;
+  ip6_match_t *matches;
+  if (!(log = generate_log(lines, test_data, &expected, &len)) ||
+      !(matches = calloc(lines, sizeof(*matches))))
+    error("failed to allocate memory");
+  size_t found = scan_ip6(log, len, matches, lines);
+  for (size_t i = 0; i < found && i < expected; i++) {
+    uint8_t addr0[32];
+    parse_ip6(test_data[i].text, addr0);
+    if (memcmp(matches[i].address, addr0, 16) != 0 ||
+        matches[i].length != test_data[i].length ||
+        memcmp(log + matches[i].offset, test_data[i].text, test_data[i].length) != 0)
+    {
+      printf("mismatch for %s (scanned)\n", test_data[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (found != expected)
+    error("mismatch in number of scanned addresses");
+
+  measure_scan(log, len, matches, lines, "scan_ip6");
+
+  // text without colons is skipped 64 bytes at a time
+  for (size_t i = 0; i < len; i++)
+    if (log[i] == ':')
+      log[i] = ' ';
+  measure_scan(log, len, matches, lines, "scan_ip6 (no colons)");
+  free(matches);
+  free(log);
+
+  printf("generating test data (routes)\n");
+  size_t routes = count / 10;
+  ip6_route_t *table;
+  uint8_t (*lookups)[16];
+  uint32_t *values;
+  if (!(table = calloc(routes, sizeof(*table))) ||
+      !(lookups = calloc(count, 16)) ||
+      !(values = calloc(count, sizeof(*values))))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < routes; i++) {
+    uint8_t length;
+    generate_route(&test_data[i], &length);
+    if (parse_ip6_prefix(test_data[i].text, table[i].address, &length) !=
+          test_data[i].length)
+    {
+      printf("mismatch for %s\n", test_data[i].text);
+      exit(EXIT_FAILURE);
+    }
+    table[i].length = length;
+    table[i].value = (uint32_t)i;
+  }
+
+  // half of the addresses fall within a route, the rest is random
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < 16; j++)
+      lookups[i][j] = (uint8_t)random();
+    if (i % 2) {
+      const ip6_route_t *route = &table[random() % routes];
+      memcpy(lookups[i], route->address, route->length / 8);
+    } else {
+      lookups[i][0] = 0x20 | (lookups[i][0] & 0x1f);
+    }
+  }
+
+  ip6_lpm_t *lpm;
+  if (!(lpm = ip6_lpm_build(table, routes)))
+    error("failed to build table");
+  printf("%zu routes, %zu bytes\n", routes, ip6_lpm_size(lpm));
+
+  // compare with the longest matching route, the last of duplicates wins
+  ip6_lpm_lookup_batch(lpm, (const uint8_t (*)[16])lookups, count, values);
+  for (size_t i = 0; i < count; i++) {
+    if (ip6_lpm_lookup(lpm, lookups[i]) != values[i])
+      error("mismatch between ip6_lpm_lookup and ip6_lpm_lookup_batch");
+    if (i % 1000)
+      continue;
+    uint32_t value = IP6_LPM_NONE;
+    int32_t longest = -1;
+    for (size_t j = 0; j < routes; j++) {
+      const uint8_t length = table[j].length;
+      const uint8_t mask = (uint8_t)(0xff00u >> (length % 8));
+      if ((int32_t)length < longest ||
+          memcmp(lookups[i], table[j].address, length / 8) != 0 ||
+          (length % 8 && (lookups[i][length / 8] & mask) != table[j].address[length / 8]))
+        continue;
+      longest = length;
+      value = table[j].value;
+    }
+    if (value != values[i])
+      error("mismatch between ip6_lpm_lookup and linear search");
+  }
+
+  measure_lpm(lpm, (const uint8_t (*)[16])lookups, count, values);
+  ip6_lpm_free(lpm);
+  free(values);
+  free(lookups);
+  free(table);
+
+  printf("generating test data (ipv4)\n");
+  for (size_t i = 0; i < count; i++)
+    generate_quad(&test_data[i]);
+  for (size_t i = 0; i < count; i++) {
+    uint8_t addr0[16], addr1[16];
+    size_t length = parse_ip4(test_data[i].text, addr0);
+    if (length != test_data[i].length ||
+        memcmp(addr0, test_data[i].octets, 4) != 0 ||
+        inet_pton(AF_INET, test_data[i].text, addr1) != 1 ||
+        memcmp(addr0, addr1, 4) != 0)
+    {
+      printf("mismatch for %s\n", test_data[i].text);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  BEST_TIME(/**/,
+    parse_ip4(test_data[i].text, addr),
+    "parse_ip4", count, 1);
+  BEST_TIME(/**/,
+    inet_pton(AF_INET, test_data[i].text, addr),
+    "inet_pton (ipv4)", count, 1);
+
+  free(test_data);
+  return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * bits.h -- bit manipulation helpers shared by the parsers
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef BITS_H
+#define BITS_H
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#ifndef likely
+#define likely(params) __builtin_expect(!!(params), 1)
+#endif
+#ifndef unlikely
+#define unlikely(params) __builtin_expect(!!(params), 0)
+#endif
+
+__attribute__((always_inline))
+static inline uint64_t count_ones(uint64_t value)
+{
+  return _mm_popcnt_u64(value);
+}
+
+__attribute__((always_inline))
+static inline uint64_t trailing_zeros(uint64_t value)
+{
+  return _tzcnt_u64(value);
+}
+
+__attribute__((always_inline))
+static inline uint64_t first_trailing_one(uint64_t value)
+{
+  return _blsi_u64(value);
+}
+
+__attribute__((always_inline))
+static inline uint64_t clear_lowest_bit(uint64_t value)
+{
+  return _blsr_u64(value);
+}
+
+__attribute__((always_inline))
+static inline uint64_t leading_zeros(uint64_t value)
+{
+  return _lzcnt_u64(value);
+}
+
+#endif // BITS_H
@@ -0,0 +1,42 @@
+/*
+ * corpus.h -- binary corpus of addresses generated by perm
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdint.h>
+
+// a corpus is a header followed by fixed-size records and a trailing block
+// of zeros, all 64 bytes. text is nul-terminated and is directly followed by
+// the octets, the trailing block ensures parsers can read IP6_PADDING bytes
+// past the last address. the file can be mapped and used as is
+#define CORPUS_MAGIC "ip6corp"
+#define CORPUS_VERSION (1u)
+
+typedef struct corpus_header corpus_header_t;
+struct corpus_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+  uint64_t seed;
+  uint8_t reserved[32];
+};
+
+typedef struct corpus_record corpus_record_t;
+struct corpus_record {
+  char text[48];
+  uint8_t octets[16];
+};
+
+_Static_assert(sizeof(corpus_header_t) == 64, "corpus header must be 64 bytes");
+_Static_assert(sizeof(corpus_record_t) == 64, "corpus record must be 64 bytes");
+
+#define CORPUS_PADDING (64u)
+
+#endif // CORPUS_H
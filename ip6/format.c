@@ -0,0 +1,161 @@
+/*
+ * format.c -- SSE 4.1 formatter for IPv6 addresses (RFC 5952)
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <immintrin.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ip6.h"
+#include "bits.h"
+#include "pieces.h"
+
+// all groups are converted to hex (pshufb) in one go, four characters per
+// group. the text is then written two groups at a time. the state of each
+// group selects which characters make it into the output: 0-3 is the number
+// of leading zeros that is dropped, 4 is the first group of the compressed
+// run (written as a single colon), 5 is any other group in the run (not
+// written at all). colons are blended in for indexes with the high bit set.
+// the shuffle for each pair of states is generated by perm (pieces.h)
+
+// number of leading zeros to drop given the zero nibbles in a group, the
+// last digit is always written
+static const uint8_t leading_zeros_by_nibbles[16] = {
+  0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 3
+};
+
+// write the dotted quad for the trailing 32 bits, four bytes per octet
+__attribute__((always_inline))
+static inline size_t format_dotted_quad(__m128i address, char *dst)
+{
+  const __m128i values = _mm_cvtepu8_epi16(_mm_srli_si128(address, 12));
+  // division by 100 and 10 by multiplication, exact for values up to 255
+  const __m128i hundreds = _mm_mulhi_epu16(values, _mm_set1_epi16(656));
+  const __m128i tens = _mm_mulhi_epu16(values, _mm_set1_epi16(6554));
+  const __m128i ones =
+    _mm_sub_epi16(values, _mm_mullo_epi16(tens, _mm_set1_epi16(10)));
+  const __m128i upper = _mm_packus_epi16(
+    hundreds,
+    _mm_sub_epi16(tens, _mm_mullo_epi16(hundreds, _mm_set1_epi16(10))));
+  const __m128i lower = _mm_packus_epi16(ones, ones);
+
+  // [hundreds, tens, ones, dot] per octet
+  __m128i text = _mm_shuffle_epi8(
+    _mm_or_si128(upper, _mm_slli_si128(lower, 4)), _mm_setr_epi8(
+      0, 8, 4, -128, 1, 9, 5, -128, 2, 10, 6, -128, 3, 11, 7, -128));
+  text = _mm_add_epi8(text, _mm_setr_epi8(
+    '0', '0', '0', '.', '0', '0', '0', '.', '0', '0', '0', '.', '0', '0', '0', '.'));
+
+  // shift out leading zeros, byte i of an octet takes byte i + zeros
+  const __m128i octets = _mm_cvtepu16_epi32(values);
+  const __m128i zeros = _mm_add_epi32(
+    _mm_cmpgt_epi32(_mm_set1_epi32(10), octets),
+    _mm_cmpgt_epi32(_mm_set1_epi32(100), octets));
+  const __m128i positions = _mm_add_epi8(
+    _mm_shuffle_epi8(_mm_sub_epi32(_mm_setzero_si128(), zeros), _mm_setr_epi8(
+      0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12)),
+    _mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3));
+  text = _mm_shuffle_epi8(text, _mm_or_si128(
+    _mm_add_epi8(positions, _mm_setr_epi8(
+      0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12)),
+    _mm_cmpgt_epi8(positions, _mm_set1_epi8(3))));
+  __m128i lengths = _mm_add_epi32(zeros, _mm_set1_epi32(4));
+
+  size_t length = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    const uint32_t quad = (uint32_t)_mm_extract_epi32(text, 0);
+    memcpy(dst + length, &quad, sizeof(quad));
+    length += (uint32_t)_mm_extract_epi32(lengths, 0);
+    text = _mm_srli_si128(text, 4);
+    lengths = _mm_srli_si128(lengths, 4);
+  }
+
+  return length - 1;
+}
+
+__attribute__((always_inline))
+static inline size_t format(const void *src, char *dst)
+{
+  const __m128i address = _mm_loadu_si128((const __m128i *)src);
+
+  // longest run of at least two zero groups, the first if there is a tie
+  const uint32_t zeros = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(
+    _mm_cmpeq_epi16(address, _mm_setzero_si128()), _mm_setzero_si128()));
+  uint32_t run = zeros & (zeros >> 1), start = 8, end = 8;
+  if (run) {
+    end = 2;
+    while (run & (run >> 1)) {
+      run &= run >> 1;
+      end++;
+    }
+    start = (uint32_t)trailing_zeros(run);
+    end += start;
+  }
+
+  // IPv4-mapped addresses (::ffff:0:0/96) end in a dotted quad
+  if (unlikely(start == 0 && end == 5 && _mm_extract_epi16(address, 5) == 0xffff)) {
+    memcpy(dst, "::ffff:", 8);
+    return 7 + format_dotted_quad(address, dst + 7);
+  }
+
+  const __m128i hex = _mm_setr_epi8(
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+  const __m128i high =
+    _mm_and_si128(_mm_srli_epi16(address, 4), _mm_set1_epi8(0x0f));
+  const __m128i low = _mm_and_si128(address, _mm_set1_epi8(0x0f));
+  const __m128i nibbles[2] = {
+    _mm_unpacklo_epi8(high, low), _mm_unpackhi_epi8(high, low) };
+  const __m128i text[2] = {
+    _mm_shuffle_epi8(hex, nibbles[0]), _mm_shuffle_epi8(hex, nibbles[1]) };
+  const uint32_t zero_nibbles =
+    (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(nibbles[0], _mm_setzero_si128())) |
+    (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(nibbles[1], _mm_setzero_si128())) << 16;
+
+  uint32_t states[8];
+  for (uint32_t group = 0; group < 8; group++) {
+    const uint32_t state =
+      leading_zeros_by_nibbles[(zero_nibbles >> (group * 4)) & 0xfu];
+    states[group] = group == start ? 4u : group > start && group < end ? 5u : state;
+  }
+
+  // a leading :: requires an additional colon
+  size_t length = start == 0;
+  dst[0] = ':';
+  for (uint32_t pair = 0; pair < 4; pair++) {
+    const uint32_t key = states[2*pair] + 6 * states[2*pair + 1];
+    const __m128i shuffle = _mm_add_epi8(
+      _mm_loadu_si128((const __m128i *)pieces[key].shuffle),
+      _mm_set1_epi8((char)((pair & 1) * 8)));
+    const __m128i piece = _mm_blendv_epi8(
+      _mm_shuffle_epi8(text[pair >> 1], shuffle), _mm_set1_epi8(':'), shuffle);
+    _mm_storeu_si128((__m128i *)(dst + length), piece);
+    length += pieces[key].length;
+  }
+
+  // every group is followed by a colon, drop it unless :: is trailing
+  return length - (end != 8 || start == 8);
+}
+
+size_t format_ip6(const void *src, char *dst)
+{
+  const size_t length = format(src, dst);
+  dst[length] = '\0';
+  return length;
+}
+
+size_t format_ip6_batch(const uint8_t (*src)[16], size_t count, char *dst)
+{
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++) {
+    length += format(src[i], dst + length);
+    dst[length++] = '\n';
+  }
+  return length;
+}
@@ -7,11 +7,18 @@
  *
  */
 #include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <inttypes.h>
 #include <immintrin.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 struct key {
   uint32_t mask;
@@ -96,65 +103,506 @@ static bool permutate(struct table *table, const uint32_t mask, uint32_t bit, co
   return true;
 }
 
+// dotted quads consist of four octets of one to three digits, the mask has
+// a bit set for each dot and for the delimiter
+static bool add_quads(struct table *table)
+{
+  for (uint32_t layout=0; layout < 81; layout++) {
+    uint32_t mask = 0, position = 0;
+    for (uint32_t octet=0, lengths=layout; octet < 4; octet++, lengths /= 3) {
+      position += 1 + lengths % 3;
+      mask |= (1lu << position);
+      position++;
+    }
+    if (!add_mask(table, mask))
+      return false;
+  }
+
+  return true;
+}
+
+static bool add_masks(struct table *table, const uint32_t bits, const bool quads)
+{
+  if (quads)
+    return add_quads(table);
+
+  add_mask(table, 0);
+  for (uint32_t bit=0; bit < 5; bit++) {
+    const uint32_t m = 1lu << bit;
+    if (!add_mask(table, m))
+      return false;
+    if (!permutate(table, m, bit, bits, 0))
+      return false;
+  }
+
+  return true;
+}
+
+static struct table *new_table(
+  const uint32_t seed, const uint32_t shift_bits, const uint32_t mask_bits, const uint32_t bits)
+{
+  struct table *table;
+  const size_t table_size = sizeof(struct table) + (1lu << mask_bits) * sizeof(struct key);
+  if (!(table = calloc(1, table_size)))
+    return NULL;
+  table->seed = seed;
+  table->mask = (1lu << mask_bits) - 1;
+  table->shift = shift_bits;
+  table->groups = bits / 4;
+  return table;
+}
+
+// enumerate distinct (prefix) masks once by hashing with the identity, the
+// search then iterates a flat array rather than recursing for every seed
+static uint32_t *enumerate(const uint32_t bits, const bool quads, uint32_t *count)
+{
+  struct table *table;
+  uint32_t *masks = NULL;
+  if (!(table = new_table(1, 0, bits, bits)))
+    return NULL;
+  if (add_masks(table, bits, quads) && (masks = malloc(table->unique * sizeof(*masks)))) {
+    *count = 0;
+    for (uint32_t i=0; i <= table->mask; i++)
+      if (table->keys[i].count)
+        masks[(*count)++] = table->keys[i].mask;
+  }
+  free(table);
+  return masks;
+}
+
+static int compare_masks(const void *a, const void *b)
+{
+  const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+// positions of the delimiters in mask, returns the number of delimiters
+static uint32_t delimiters(uint32_t mask, uint32_t positions[32])
+{
+  uint32_t count = 0;
+  for (; mask; mask &= mask - 1)
+    positions[count++] = (uint32_t)__builtin_ctz(mask);
+  return count;
+}
+
+// shuffle for pairs of groups, digits are right-aligned into four nibbles
+// per group
+static void write_shuffle(FILE *file, const uint32_t mask, const uint32_t groups)
+{
+  uint32_t positions[32];
+  const uint32_t count = delimiters(mask, positions);
+
+  for (uint32_t group=0; group < groups; group++) {
+    const uint32_t start = group && group <= count ? positions[group - 1] + 1 : 0;
+    const uint32_t digits = group < count ? positions[group] - start : 0;
+    for (uint32_t nibble=0; nibble < 4; nibble++) {
+      const uint32_t index = nibble < 4 - digits ? 128 : start + nibble - (4 - digits);
+      fprintf(file, "%s%3u", group || nibble ? ", " : " ", index);
+    }
+  }
+}
+
+static void write_pattern(FILE *file, const uint32_t mask, const uint32_t groups)
+{
+  uint32_t positions[32];
+  const uint32_t count = delimiters(mask, positions);
+  const uint32_t shift = count ? positions[count - 1] + 1 : 0;
+
+  fprintf(file, "  { %3u, %2u, %u, {", mask, shift, count * 2);
+  write_shuffle(file, mask, groups);
+  fprintf(file, " } }");
+}
+
+// shuffle for dotted quads, digits are right-aligned into [hundreds, tens,
+// ones, 0] per octet
+static void write_quad(FILE *file, const uint32_t mask)
+{
+  uint32_t positions[32];
+  const uint32_t count = delimiters(mask, positions);
+  assert(count == 4);
+  (void)count;
+
+  fprintf(file, "  { %5u, {", mask);
+  for (uint32_t octet=0; octet < 4; octet++) {
+    const uint32_t start = octet ? positions[octet - 1] + 1 : 0;
+    const uint32_t digits = positions[octet] - start;
+    for (uint32_t digit=0; digit < 4; digit++) {
+      const uint32_t index = digit < 3 - digits || digit == 3 ? 128 : start + digit - (3 - digits);
+      fprintf(file, "%s%3u", octet || digit ? ", " : " ", index);
+    }
+  }
+  fprintf(file, " } }");
+}
+
+// write the magic, the id per slot and the shuffle per mask. unused slots
+// refer to the first entry, the mask of which cannot match
+static bool write_header(const char *path, const struct table *table, const uint32_t bits, const bool quads)
+{
+  const char *name = quads ? "quads" : "patterns";
+  const char *prefix = quads ? "QUAD" : "PATTERN";
+  const char *ids = quads ? "quad_ids" : "pattern_ids";
+  const uint32_t size = table->mask + 1;
+  uint32_t *masks, count = 0;
+  uint8_t *slots;
+  FILE *file;
+
+  if (!(masks = malloc(size * sizeof(*masks))) || !(slots = calloc(size, 1))) {
+    free(masks);
+    return false;
+  }
+  for (uint32_t i=0; i < size; i++)
+    if (table->keys[i].count)
+      masks[count++] = table->keys[i].mask;
+  qsort(masks, count, sizeof(*masks), compare_masks);
+  for (uint32_t id=0; id < count; id++)
+    slots[((masks[id] * table->seed) >> table->shift) & table->mask] = (uint8_t)id;
+
+  if (count > 256 || !(file = fopen(path, "w"))) {
+    free(slots);
+    free(masks);
+    return false;
+  }
+
+  fprintf(file, "/*\n * %s.h -- shuffle patterns for %s\n *\n", name, quads ? "dotted quads" : "two consecutive groups");
+  fprintf(file, " * generated by hash, do not edit\n *\n */\n");
+  fprintf(file, "#ifndef %sS_H\n#define %sS_H\n\n#include <stdint.h>\n\n", prefix, prefix);
+  fprintf(file, "// magic (bits: %u, shift_bits: %u, mask_bits: %u, key: %u)\n",
+          bits, table->shift, __builtin_popcount(table->mask), table->seed);
+  fprintf(file, "#define %s_BITS (%u)\n", prefix, bits);
+  fprintf(file, "#define %s_KEY (%uu)\n", prefix, table->seed);
+  fprintf(file, "#define %s_SHIFT (%u)\n", prefix, table->shift);
+  fprintf(file, "#define %s_MASK (0x%xu)\n\n", prefix, table->mask);
+
+  fprintf(file, "static const uint8_t %s[%u] = {", ids, size);
+  for (uint32_t i=0; i < size; i++)
+    fprintf(file, "%s%3u", i % 8 ? ", " : i ? ",\n  " : "\n  ", slots[i]);
+  fprintf(file, "\n};\n\n");
+
+  if (quads) {
+    fprintf(file, "// shuffle digits right-aligned into [hundreds, tens, ones, 0] per octet\n");
+    fprintf(file, "static const struct {\n  uint16_t mask;\n  uint8_t shuffle[16];\n} quads[%u] = {\n", count);
+  } else {
+    fprintf(file, "static const struct {\n  uint32_t mask;\n  uint16_t shift;\n  uint16_t bytes;\n");
+    fprintf(file, "  uint8_t shuffle[%u];\n} patterns[%u] = {\n", 4 * table->groups, count);
+  }
+  for (uint32_t id=0; id < count; id++) {
+    if (quads)
+      write_quad(file, masks[id]);
+    else
+      write_pattern(file, masks[id], table->groups);
+    fprintf(file, "%s // %2u: ", id + 1 < count ? "," : " ", id);
+    for (uint32_t bit=0; bit < bits; bit++)
+      fputc(masks[id] & (1lu << bit) ? '1' : '0', file);
+    fputc('\n', file);
+  }
+  fprintf(file, "};\n\n");
+
+  // the same patterns stored in the slots themselves, a lookup is a single
+  // load. entries are 16 bytes for pairs of groups, four to a cache line
+  if (!quads) {
+    fprintf(file, "// patterns by slot (slot: id), unused slots hold the first pattern\n");
+    fprintf(file, "static const struct {\n  uint8_t shuffle[%u];\n  uint32_t mask;\n", 4 * table->groups);
+    fprintf(file, "  uint16_t shift;\n  uint16_t bytes;\n} pattern_slots[%u] __attribute__((aligned(64))) = {\n", size);
+    for (uint32_t slot=0; slot < size; slot++) {
+      const uint32_t mask = masks[slots[slot]];
+      uint32_t positions[32];
+      const uint32_t delimiter_count = delimiters(mask, positions);
+      const uint32_t shift = delimiter_count ? positions[delimiter_count - 1] + 1 : 0;
+      fprintf(file, "  { {");
+      write_shuffle(file, mask, table->groups);
+      fprintf(file, " }, %3u, %2u, %u }%s // %2u: %2u\n", mask, shift, delimiter_count * 2,
+              slot + 1 < size ? "," : " ", slot, slots[slot]);
+    }
+    fprintf(file, "};\n\n");
+  }
+
+  fprintf(file, "#endif // %sS_H\n", prefix);
+
+  free(slots);
+  free(masks);
+  return fclose(file) == 0;
+}
+
+#define CHUNK (1u << 16)
+
+struct search {
+  uint32_t shift, mask;
+  const uint32_t *masks;
+  uint32_t count;
+  uint64_t limit;
+  _Atomic uint64_t next; // first seed of next chunk
+  _Atomic uint64_t found; // smallest seed found, or limit
+};
+
+struct worker {
+  pthread_t thread;
+  struct search *search;
+  _Atomic uint64_t current; // first seed of chunk in progress
+};
+
+// slots are tagged with the generation (seed) that claimed them, which saves
+// clearing the table for every seed
+static bool try_seed(
+  const struct search *search, const uint32_t seed, uint32_t *slots, const uint32_t generation)
+{
+  for (uint32_t i=0; i < search->count; i++) {
+    const uint32_t key = ((search->masks[i] * seed) >> search->shift) & search->mask;
+    if (slots[key] == generation)
+      return false;
+    slots[key] = generation;
+  }
+
+  return true;
+}
+
+// chunks are handed out in order and a chunk is only abandoned once a smaller
+// seed is found, the first seed found is therefore the smallest
+static void *work(void *arg)
+{
+  struct worker *worker = arg;
+  struct search *search = worker->search;
+  uint32_t *slots, generation = 0;
+
+  if (!(slots = calloc(search->mask + 1, sizeof(*slots))))
+    abort();
+
+  for (;;) {
+    const uint64_t start = atomic_fetch_add(&search->next, CHUNK);
+    atomic_store(&worker->current, start);
+    if (start >= atomic_load(&search->found))
+      break;
+    const uint64_t end = start + CHUNK < search->limit ? start + CHUNK : search->limit;
+    for (uint64_t seed=start; seed < end; seed++) {
+      if (!++generation) {
+        memset(slots, 0, (search->mask + 1) * sizeof(*slots));
+        generation = 1;
+      }
+      if (!try_seed(search, (uint32_t)seed, slots, generation))
+        continue;
+      uint64_t found = atomic_load(&search->found);
+      while (seed < found && !atomic_compare_exchange_weak(&search->found, &found, seed))
+        ;
+      break;
+    }
+  }
+
+  atomic_store(&worker->current, UINT64_MAX);
+  free(slots);
+  return NULL;
+}
+
+struct checkpoint {
+  uint32_t bits, shift_bits, mask_bits, quads;
+  uint64_t seed;
+};
+
+static bool read_checkpoint(const char *path, struct checkpoint *checkpoint)
+{
+  FILE *file;
+  bool read = false;
+  if ((file = fopen(path, "r"))) {
+    read = fscanf(file, "%" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu64,
+                  &checkpoint->bits, &checkpoint->shift_bits, &checkpoint->mask_bits,
+                  &checkpoint->quads, &checkpoint->seed) == 5;
+    fclose(file);
+  }
+  return read;
+}
+
+// all seeds below the checkpoint have been tried, write to a temporary file
+// and rename so that an interrupted write leaves the previous checkpoint
+static void write_checkpoint(const char *path, const struct checkpoint *checkpoint)
+{
+  char temporary[4096];
+  FILE *file;
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  if (!(file = fopen(temporary, "w")))
+    return;
+  fprintf(file, "%" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu64 "\n",
+          checkpoint->bits, checkpoint->shift_bits, checkpoint->mask_bits,
+          checkpoint->quads, checkpoint->seed);
+  if (fclose(file) == 0)
+    rename(temporary, path);
+}
+
+// search seeds from start up to limit across threads, returns the smallest
+// seed that yields a perfect hash, or limit if there is none
+static uint64_t search_seeds(
+  struct search *search, const uint64_t start, const uint32_t threads,
+  const char *path, struct checkpoint *checkpoint)
+{
+  struct worker *workers;
+  if (!(workers = calloc(threads, sizeof(*workers))))
+    abort();
+
+  atomic_store(&search->next, start);
+  atomic_store(&search->found, search->limit);
+  for (uint32_t i=0; i < threads; i++) {
+    workers[i].search = search;
+    atomic_store(&workers[i].current, start);
+    if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0)
+      abort();
+  }
+
+  for (uint32_t tick=1;; tick++) {
+    const struct timespec interval = { 0, 10000000 }; // 10ms
+    nanosleep(&interval, NULL);
+    uint64_t done = UINT64_MAX;
+    for (uint32_t i=0; i < threads; i++) {
+      const uint64_t current = atomic_load(&workers[i].current);
+      done = current < done ? current : done;
+    }
+    if (done == UINT64_MAX)
+      break;
+    if (path && tick % 1000 == 0) { // 10s
+      checkpoint->seed = done;
+      write_checkpoint(path, checkpoint);
+    }
+  }
+
+  for (uint32_t i=0; i < threads; i++)
+    pthread_join(workers[i].thread, NULL);
+  free(workers);
+
+  const uint64_t found = atomic_load(&search->found);
+  if (path) {
+    checkpoint->seed = found < search->limit ? found : search->limit;
+    write_checkpoint(path, checkpoint);
+  }
+  return found;
+}
+
 static void usage(const char *str)
 {
-  fprintf(stderr, "Usage: %s BITS SHIFT_BITS MASK_BITS\n", str);
+  fprintf(stderr, "Usage: %s [-4] [-s] [-j THREADS] [-l LIMIT] [-c CHECKPOINT] [-o HEADER] BITS SHIFT_BITS MASK_BITS\n", str);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  -4             search magic for dotted quads rather than pairs of groups\n");
+  fprintf(stderr, "  -s             search the smallest table, MASK_BITS is the maximum\n");
+  fprintf(stderr, "  -j THREADS     number of threads (default: number of processors)\n");
+  fprintf(stderr, "  -l LIMIT       try seeds below LIMIT (per table size)\n");
+  fprintf(stderr, "  -c CHECKPOINT  record progress in and resume from CHECKPOINT\n");
+  fprintf(stderr, "  -o HEADER      write tables to HEADER rather than print the table\n");
   exit(EXIT_FAILURE);
 }
 
+static uint64_t parse_number(const char *program, const char *str, const uint64_t minimum, const uint64_t maximum)
+{
+  char *end = NULL;
+  errno = 0;
+  const uint64_t number = strtoull(str, &end, 10);
+  if (errno || end == str || *end || number < minimum || number > maximum)
+    usage(program);
+  return number;
+}
+
 int main(int argc, char *argv[])
 {
-  if (argc != 4)
-    usage(argv[0]);
+  const char *program = argv[0];
+  const char *path = NULL, *header = NULL;
+  bool quads = false, smallest = false;
+  uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t limit = UINT32_MAX;
 
-  char *end = argv[1];
-  uint32_t bits = strtoul(argv[1], &end, 10);
-  if (!bits || end == argv[1] || *end)
-    usage(argv[0]);
+  // progress is followed through a pipe
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  int option;
+  while ((option = getopt(argc, argv, "4sj:l:c:o:")) != -1) {
+    switch (option) {
+      case '4':
+        quads = true;
+        break;
+      case 's':
+        smallest = true;
+        break;
+      case 'j':
+        threads = (uint32_t)parse_number(program, optarg, 1, 1024);
+        break;
+      case 'l':
+        limit = parse_number(program, optarg, 2, UINT32_MAX);
+        break;
+      case 'c':
+        path = optarg;
+        break;
+      case 'o':
+        header = optarg;
+        break;
+      default:
+        usage(program);
+    }
+  }
 
-  end = argv[2];
-  uint32_t shift_bits = strtoul(argv[2], &end, 10);
-  if (end == argv[2] || *end)
-    usage(argv[0]);
+  if (argc - optind != 3)
+    usage(program);
 
-  end = argv[3];
-  uint32_t mask_bits = strtoul(argv[3], &end, 10);
-  if (end == argv[3] || *end)
-    usage(argv[0]);
+  const uint32_t bits = (uint32_t)parse_number(program, argv[optind], 1, 16);
+  const uint32_t shift_bits = (uint32_t)parse_number(program, argv[optind+1], 0, 31);
+  const uint32_t mask_bits = (uint32_t)parse_number(program, argv[optind+2], 1, 24);
 
-  struct table *table;
-  const size_t table_size = sizeof(struct table) + (1lu << mask_bits) * sizeof(struct key);
-  if (!(table = malloc(table_size)))
+  uint32_t count = 0, *masks;
+  if (!(masks = enumerate(bits, quads, &count))) {
+    fprintf(stderr, "Cannot enumerate masks for %u bits\n", bits);
     return EXIT_FAILURE;
+  }
 
-  const uint32_t mask = (1lu << mask_bits) - 1;
+  // smallest table that can hold every mask
+  uint32_t minimum_bits = mask_bits;
+  if (smallest)
+    for (minimum_bits = 1; (1lu << minimum_bits) < count; minimum_bits++)
+      ;
 
-  printf("bits: %u, shift bits: %u, mask bits: %u (0x%x), table size: %u\n", bits, shift_bits, mask_bits, mask, table_size);
+  struct checkpoint checkpoint = { bits, shift_bits, minimum_bits, quads, 1 };
+  struct checkpoint resume;
+  if (path && read_checkpoint(path, &resume) &&
+      resume.bits == bits && resume.shift_bits == shift_bits && resume.quads == quads &&
+      resume.mask_bits >= minimum_bits && resume.mask_bits <= mask_bits)
+  {
+    checkpoint = resume;
+    printf("resuming from mask bits: %u, seed: %" PRIu64 "\n", checkpoint.mask_bits, checkpoint.seed);
+  }
+
+  printf("bits: %u, shift bits: %u, mask bits: %u, masks: %u, threads: %u\n",
+         bits, shift_bits, mask_bits, count, threads);
   printf("maximum full hextets: %u\n", bits / 4);
-  for (uint32_t seed=1llu; seed < UINT32_MAX; seed++) {
-    memset(table, 0, table_size);
-    table->seed = seed;
-    table->mask = mask;
-    table->shift = shift_bits;
-    table->groups = bits / 4;
-
-    add_mask(table, 0);
-    for (uint32_t bit=0; bit < 5; bit++) {
-      const uint32_t m = 1lu << bit;
-      if (!add_mask(table, m))
-        goto next;
-      if (!permutate(table, m, bit, bits, 0))
-        goto next;
+
+  int status = EXIT_FAILURE;
+  for (uint32_t size_bits=checkpoint.mask_bits; size_bits <= mask_bits; size_bits++) {
+    struct search search = {
+      .shift = shift_bits, .mask = (1lu << size_bits) - 1,
+      .masks = masks, .count = count, .limit = limit };
+    checkpoint.mask_bits = size_bits;
+    if (checkpoint.seed >= limit || (1lu << size_bits) < count) {
+      checkpoint.seed = 1;
+      continue;
+    }
+
+    const uint64_t seed = search_seeds(&search, checkpoint.seed, threads, path, &checkpoint);
+    if (seed >= limit) {
+      printf("no magic for mask_bits: %u below %" PRIu64 "\n", size_bits, limit);
+      checkpoint.seed = 1;
+      continue;
     }
 
-    printf("found magic! bits: %u, shift_bits: %u, mask_bits: %u, key: %u\n", bits, shift_bits, mask_bits, seed);
+    struct table *table;
+    if (!(table = new_table((uint32_t)seed, shift_bits, size_bits, bits)))
+      break;
+    if (!add_masks(table, bits, quads))
+      abort();
+    printf("found magic! bits: %u, shift_bits: %u, mask_bits: %u, key: %u\n", bits, shift_bits, size_bits, table->seed);
     printf("total: %u, unique: %u\n", table->total, table->unique);
-    print_table(table);
+    if (!header) {
+      print_table(table);
+      status = EXIT_SUCCESS;
+    } else if (write_header(header, table, bits, quads)) {
+      status = EXIT_SUCCESS;
+    } else {
+      fprintf(stderr, "Cannot write %s\n", header);
+    }
+    free(table);
     break;
-next:
   }
 
-  free(table);
+  free(masks);
 
-  return EXIT_SUCCESS;
+  return status;
 }
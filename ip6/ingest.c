@@ -0,0 +1,278 @@
+/*
+ * ingest.c -- parse a file of IPv6 addresses across threads
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ip6.h"
+#include "bits.h"
+#include "ingest.h"
+
+// the input is mapped, not copied. the file is mapped over an anonymous
+// mapping of at least IP6_PADDING bytes more, the parsers may therefore read
+// past the last address. chunks are aligned to lines, each worker parses its
+// chunk into a buffer of its own. line numbers and output offsets follow
+// from the counts of preceding chunks once all workers are done
+
+typedef struct reject reject_t;
+struct reject { uint64_t line; const char *text; size_t length; };
+
+typedef struct chunk chunk_t;
+struct chunk {
+  pthread_t thread;
+  const char *start, *end;
+  uint64_t lines;
+  uint8_t (*addresses)[16];
+  size_t count, capacity;
+  reject_t *rejects;
+  size_t reject_count, reject_capacity;
+  bool failed;
+#if defined(IP6_STATS)
+  ip6_stats_t stats;
+#endif
+};
+
+// double the capacity of buffer, returns NULL if out of memory
+static void *grow(void *buffer, size_t *capacity, size_t size)
+{
+  const size_t count = *capacity ? 2 * *capacity : 65536;
+  if (!(buffer = realloc(buffer, count * size)))
+    return NULL;
+  *capacity = count;
+  return buffer;
+}
+
+static void *work(void *argument)
+{
+  chunk_t *chunk = argument;
+  const char *cursor = chunk->start, *end = chunk->end;
+
+  while (cursor < end) {
+    chunk->lines++;
+    // parsers may write 32 bytes, keep room for one more address
+    if (chunk->count + 2 > chunk->capacity) {
+      void *addresses = grow(chunk->addresses, &chunk->capacity, 16);
+      if (!addresses)
+        goto failed;
+      chunk->addresses = addresses;
+    }
+
+    // an address is accepted if the line ends directly after it, the
+    // parser stops at a newline and therefore never crosses into the next
+    const size_t size = parse_ip6(cursor, chunk->addresses[chunk->count]);
+    const char *next = cursor + size;
+    if (*next == '\r')
+      next++;
+    if (likely(size && (*next == '\n' || next >= end))) {
+      chunk->count++;
+      cursor = next + 1;
+      continue;
+    }
+
+    const char *newline = memchr(cursor, '\n', (size_t)(end - cursor));
+    if (!newline)
+      newline = end;
+    size_t length = (size_t)(newline - cursor);
+    if (length && cursor[length - 1] == '\r')
+      length--;
+    // empty lines are skipped silently
+    if (length) {
+      if (chunk->reject_count == chunk->reject_capacity) {
+        void *rejects = grow(chunk->rejects, &chunk->reject_capacity, sizeof(reject_t));
+        if (!rejects)
+          goto failed;
+        chunk->rejects = rejects;
+      }
+      chunk->rejects[chunk->reject_count++] =
+        (reject_t){ chunk->lines, cursor, length };
+    }
+    cursor = newline + 1;
+  }
+
+#if defined(IP6_STATS)
+  ip6_stats_collect(&chunk->stats);
+#endif
+  return NULL;
+failed:
+  chunk->failed = true;
+  return NULL;
+}
+
+static const char *map(const char *path, size_t *size, size_t *mapped)
+{
+  int fd;
+  struct stat st;
+  if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return NULL;
+  }
+
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  *size = (size_t)st.st_size;
+  *mapped = (*size + IP6_PADDING + page - 1) & ~(page - 1);
+
+  char *base = mmap(NULL, *mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED ||
+      (*size && mmap(base, *size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED))
+  {
+    fprintf(stderr, "Cannot map %s\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  madvise(base, *size, MADV_SEQUENTIAL);
+  close(fd);
+  return base;
+}
+
+static bool write_output(const char *path, const chunk_t *chunks, uint32_t count)
+{
+  FILE *file;
+  if (!(file = fopen(path, "wb"))) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++)
+    fwrite(chunks[i].addresses, 16, chunks[i].count, file);
+  if (ferror(file) | fclose(file)) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+static bool write_rejects(const char *path, const chunk_t *chunks, uint32_t count)
+{
+  FILE *file;
+  if (!(file = fopen(path, "w"))) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  uint64_t lines = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < chunks[i].reject_count; j++) {
+      const reject_t *reject = &chunks[i].rejects[j];
+      fprintf(file, "%" PRIu64 "\t%.*s\n",
+        lines + reject->line, (int)reject->length, reject->text);
+    }
+    lines += chunks[i].lines;
+  }
+  if (ferror(file) | fclose(file)) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+#if defined(IP6_STATS)
+static bool write_stats(const char *path, const chunk_t *chunks, uint32_t count)
+{
+  ip6_stats_t stats = { 0 };
+  for (uint32_t i = 0; i < count; i++) {
+    const uint64_t *counters = (const uint64_t *)&chunks[i].stats;
+    uint64_t *totals = (uint64_t *)&stats;
+    for (size_t j = 0; j < sizeof(stats) / sizeof(uint64_t); j++)
+      totals[j] += counters[j];
+  }
+
+  FILE *file;
+  if (!(file = fopen(path, "w"))) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  if ((ip6_stats_dump(file, &stats) != 0) | fclose(file)) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  return true;
+}
+#endif
+
+int ingest(
+  const char *input, const char *output, const char *rejects,
+  const char *stats, uint32_t threads)
+{
+  size_t size, mapped;
+  const char *text;
+  if (!(text = map(input, &size, &mapped)))
+    return EXIT_FAILURE;
+
+  chunk_t *chunks;
+  if (!(chunks = calloc(threads, sizeof(*chunks)))) {
+    munmap((void *)text, mapped);
+    return EXIT_FAILURE;
+  }
+
+  // chunks end after the first newline at or past an even split
+  const char *start = text, *end = text + size;
+  for (uint32_t i = 0; i < threads; i++) {
+    const char *split = text + (size / threads) * (i + 1);
+    if (split < start)
+      split = start;
+    const char *newline = memchr(split, '\n', (size_t)(end - split));
+    chunks[i].start = start;
+    chunks[i].end = i + 1 < threads && newline ? newline + 1 : end;
+    start = chunks[i].end;
+  }
+
+  struct timespec begin, finish;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  uint32_t started = 0;
+  for (; started < threads; started++)
+    if (pthread_create(&chunks[started].thread, NULL, work, &chunks[started]) != 0)
+      break;
+  for (uint32_t i = 0; i < started; i++)
+    pthread_join(chunks[i].thread, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+
+  bool failed = started < threads;
+  uint64_t addresses = 0, rejected = 0;
+  for (uint32_t i = 0; i < threads; i++) {
+    failed |= chunks[i].failed;
+    addresses += chunks[i].count;
+    rejected += chunks[i].reject_count;
+  }
+
+  if (failed)
+    fprintf(stderr, "Cannot parse %s, out of memory or threads\n", input);
+  else if ((output && !write_output(output, chunks, threads)) ||
+           (rejects && !write_rejects(rejects, chunks, threads)))
+    failed = true;
+#if defined(IP6_STATS)
+  else if (stats && !write_stats(stats, chunks, threads))
+    failed = true;
+#else
+  (void)stats;
+#endif
+
+  if (!failed) {
+    const double seconds = (double)(finish.tv_sec - begin.tv_sec) +
+                           (double)(finish.tv_nsec - begin.tv_nsec) / 1e9;
+    printf("parsed %" PRIu64 " addresses, rejected %" PRIu64 ", "
+           "%zu bytes in %.3f s (%.2f GB/s, %u threads, %s)\n",
+      addresses, rejected, size, seconds, (double)size / seconds / 1e9,
+      threads, parse_ip6_engine());
+  }
+
+  for (uint32_t i = 0; i < threads; i++) {
+    free(chunks[i].addresses);
+    free(chunks[i].rejects);
+  }
+  free(chunks);
+  munmap((void *)text, mapped);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+/*
+ * ingest.h -- parse a file of IPv6 addresses across threads
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stdint.h>
+
+// parse input, one address per line, with the given number of threads.
+// valid addresses are written to output (if not NULL) as 16 bytes each, in
+// order. rejected lines are written to rejects (if not NULL) as the line
+// number and the text, separated by a tab. empty lines are skipped. the
+// counters of the parsers are written to stats (if not NULL), which requires
+// a library built with IP6_STATS
+int ingest(
+  const char *input, const char *output, const char *rejects,
+  const char *stats, uint32_t threads);
+
+#endif // INGEST_H
@@ -0,0 +1,25 @@
+/*
+ * ip4.c -- SSE 4.1 parser for IPv4 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <immintrin.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ip6.h"
+#include "ip4.h"
+
+__attribute__((noinline))
+size_t parse_ip4(const char *src, void *dst)
+{
+  uint32_t octets, length;
+  if (!(length = parse_dotted_quad(
+        _mm_loadu_si128((const __m128i *)src), 0, &octets)))
+    return 0u;
+  memcpy(dst, &octets, sizeof(octets));
+  return length;
+}
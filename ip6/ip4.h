@@ -0,0 +1,66 @@
+/*
+ * ip4.h -- SSE 4.1 conversion of dotted quads
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef IP4_H
+#define IP4_H
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "bits.h"
+#include "quads.h"
+
+// convert the dotted quad at offset in text, which must be terminated within
+// the 16-byte window. returns the length, or 0 if the quad is invalid or not
+// terminated within the window. octets are in network order
+__attribute__((always_inline))
+static inline uint32_t parse_dotted_quad(
+  __m128i text, uint32_t offset, uint32_t *octets)
+{
+  const __m128i digits = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+  const uint64_t dots = (uint16_t)_mm_movemask_epi8(
+    _mm_cmpeq_epi8(text, _mm_set1_epi8('.'))) >> offset;
+  const uint64_t non_digits = (uint16_t)~_mm_movemask_epi8(
+    _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits)) >> offset;
+
+  const uint64_t delimiter = first_trailing_one(non_digits ^ dots);
+  const uint32_t mask = (uint32_t)((dots & (delimiter - 1llu)) | delimiter);
+  const uint32_t hash = ((mask * QUAD_KEY) >> QUAD_SHIFT) & QUAD_MASK;
+  const uint8_t key = quad_ids[hash];
+  if (!delimiter || mask != quads[key].mask)
+    return 0u;
+
+  const __m128i shuffle = _mm_loadu_si128((const __m128i *)quads[key].shuffle);
+  const __m128i input = _mm_shuffle_epi8(
+    digits, _mm_add_epi8(shuffle, _mm_set1_epi8((int8_t)offset)));
+  const __m128i values = _mm_madd_epi16(
+    _mm_maddubs_epi16(input, _mm_setr_epi8(
+      100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0)),
+    _mm_set1_epi16(1));
+
+  // leading zeros are not allowed, octets of two or three digits have a
+  // minimum value of 10 and 100 respectively
+  const __m128i present = _mm_andnot_si128(
+    _mm_cmpgt_epi8(_mm_setzero_si128(), shuffle), _mm_set1_epi8(1));
+  const __m128i minimums = _mm_madd_epi16(
+    _mm_maddubs_epi16(present, _mm_setr_epi8(
+      90, 10, 0, 0, 90, 10, 0, 0, 90, 10, 0, 0, 90, 10, 0, 0)),
+    _mm_set1_epi16(1));
+
+  const __m128i invalid = _mm_or_si128(
+    _mm_cmpgt_epi32(values, _mm_set1_epi32(255)),
+    _mm_cmpgt_epi32(minimums, values));
+  if (!_mm_testz_si128(invalid, invalid))
+    return 0u;
+
+  const __m128i packed = _mm_packus_epi32(values, values);
+  *octets = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+  return (uint32_t)trailing_zeros(delimiter);
+}
+
+#endif // IP4_H
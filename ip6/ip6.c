@@ -14,227 +14,128 @@
 #include <inttypes.h>
 #include <arpa/inet.h>
 
-#define likely(params) __builtin_expect(!!(params), 1)
-#define unlikely(params) __builtin_expect(!!(params), 0)
+#include "ip6.h"
+#include "sse41.h"
 
-__attribute__((always_inline))
-static inline uint64_t count_ones(uint64_t value)
-{
-  return _mm_popcnt_u64(value);
-}
-
-__attribute__((always_inline))
-static inline uint64_t trailing_zeros(uint64_t value)
-{
-  return _tzcnt_u64(value);
-}
-
-__attribute__((always_inline))
-static inline uint64_t first_trailing_one(uint64_t value)
+__attribute__((noinline))
+size_t parse_ip6_sse41(const char *src, void *dst)
 {
-  return _blsi_u64(value);
+  return parse_ip6_inline(src, dst);
 }
 
-__attribute__((always_inline))
-static inline uint64_t clear_lowest_bit(uint64_t value)
+__attribute__((noinline))
+size_t parse_ip6_prefix(const char *src, void *dst, uint8_t *prefix)
 {
-  return _blsr_u64(value);
+  return parse_ip6_prefix_inline(src, dst, prefix);
 }
 
-// magic (bits: 10, shift_bits: 14, mask_bits: 6, key: 19146)
-static const uint8_t pattern_ids[64] = {
-    0,   1,   2,   6,   3,   7, 255,  11,
-  255,   4,   8,  12, 255,  15,  16,  19,
-  255, 255,   5,   9,  23,  13, 255,  17,
-  255, 255,  20, 255,  21,  27,  24, 255,
-  255, 255, 255, 255, 255, 255,  10,  14,
-   28,  30,  18, 255, 255, 255,  22, 255,
-  255, 255, 255, 255,  25, 255, 255, 255,
-   26, 255, 255, 255, 255,  29, 255, 255
-};
-
-static const struct {
-  uint32_t mask;
-  uint16_t shift;
-  uint16_t bytes;
-  uint8_t shuffle[8];
-} patterns[31] = {
-  {   0,  0, 0, { 128, 128, 128, 128, 128, 128, 128, 128 } }, //  0: 0000000000
-  {   1,  1, 2, { 128, 128, 128, 128, 128, 128, 128, 128 } }, //  1: 1000000000
-  {   2,  2, 2, { 128, 128, 128,   0, 128, 128, 128, 128 } }, //  2: 0100000000
-  {   4,  3, 2, { 128, 128,   0,   1, 128, 128, 128, 128 } }, //  3: 0010000000
-  {   8,  4, 2, { 128,   0,   1,   2, 128, 128, 128, 128 } }, //  4: 0001000000
-  {  16,  5, 2, {   0,   1,   2,   3, 128, 128, 128, 128 } }, //  5: 0000100000
-  {   3,  2, 4, { 128, 128, 128, 128, 128, 128, 128, 128 } }, //  6: 1100000000
-  {   5,  3, 4, { 128, 128, 128, 128, 128, 128, 128,   1 } }, //  7: 1010000000
-  {   9,  4, 4, { 128, 128, 128, 128, 128, 128,   1,   2 } }, //  8: 1001000000
-  {  17,  5, 4, { 128, 128, 128, 128, 128,   1,   2,   3 } }, //  9: 1000100000
-  {  33,  6, 4, { 128, 128, 128, 128,   1,   2,   3,   4 } }, // 10: 1000010000
-  {   6,  3, 4, { 128, 128, 128,   0, 128, 128, 128, 128 } }, // 11: 0110000000
-  {  10,  4, 4, { 128, 128, 128,   0, 128, 128, 128,   2 } }, // 12: 0101000000
-  {  18,  5, 4, { 128, 128, 128,   0, 128, 128,   2,   3 } }, // 13: 0100100000
-  {  34,  6, 4, { 128, 128, 128,   0, 128,   2,   3,   4 } }, // 14: 0100010000
-  {  66,  7, 4, { 128, 128, 128,   0,   2,   3,   4,   5 } }, // 15: 0100001000
-  {  12,  4, 4, { 128, 128,   0,   1, 128, 128, 128, 128 } }, // 16: 0011000000
-  {  20,  5, 4, { 128, 128,   0,   1, 128, 128, 128,   3 } }, // 17: 0010100000
-  {  36,  6, 4, { 128, 128,   0,   1, 128, 128,   3,   4 } }, // 18: 0010010000
-  {  68,  7, 4, { 128, 128,   0,   1, 128,   3,   4,   5 } }, // 19: 0010001000
-  { 132,  8, 4, { 128, 128,   0,   1,   3,   4,   5,   6 } }, // 20: 0010000100
-  {  24,  5, 4, { 128,   0,   1,   2, 128, 128, 128, 128 } }, // 21: 0001100000
-  {  40,  6, 4, { 128,   0,   1,   2, 128, 128, 128,   4 } }, // 22: 0001010000
-  {  72,  7, 4, { 128,   0,   1,   2, 128, 128,   4,   5 } }, // 23: 0001001000
-  { 136,  8, 4, { 128,   0,   1,   2, 128,   4,   5,   6 } }, // 24: 0001000100
-  { 264,  9, 4, { 128,   0,   1,   2,   4,   5,   6,   7 } }, // 25: 0001000010
-  {  48,  6, 4, {   0,   1,   2,   3, 128, 128, 128, 128 } }, // 26: 0000110000
-  {  80,  7, 4, {   0,   1,   2,   3, 128, 128, 128,   5 } }, // 27: 0000101000
-  { 144,  8, 4, {   0,   1,   2,   3, 128, 128,   5,   6 } }, // 28: 0000100100
-  { 272,  9, 4, {   0,   1,   2,   3, 128,   5,   6,   7 } }, // 29: 0000100010
-  { 528, 10, 4, {   0,   1,   2,   3,   5,   6,   7,   8 } }  // 30: 0000100001
-};
-
-__attribute__((warn_unused_result)) __attribute__((always_inline))
-static inline uint32_t load_shuffle_mask(
-  __m128i *shuffle, uint32_t *bytes, uint32_t mask)
+// parse address in the padded copy of src. reserved for input near the end
+// of a page and for input that reads past len may have affected
+__attribute__((noinline))
+static size_t parse_copy(const char *src, size_t len, void *dst)
 {
-  uint32_t mask0 = clear_lowest_bit(clear_lowest_bit(mask));
-  mask0 ^= mask;
-  mask0 &= 0x3ffu;
-  const uint32_t hash0 = ((mask0 * 19146ull) >> 14u) & 0x3f;
-  const uint8_t key0 = pattern_ids[hash0];
-
-  __m128i shuffle0 = _mm_loadu_si128((__m128i*)patterns[key0].shuffle);
-  const uint8_t shift0 = patterns[key0].shift;
-
-  mask >>= shift0;
-
-  uint32_t mask1 = clear_lowest_bit(clear_lowest_bit(mask));
-  mask1 ^= mask;
-  mask1 &= 0x3ffu;
-  const uint32_t hash1 = ((mask1 * 19146ull) >> 14u) & 0x3f;
-  const uint8_t key1 = pattern_ids[hash1];
-
-  __m128i shuffle1 = _mm_loadu_si128((__m128i*)patterns[key1].shuffle);
-          shuffle1 = _mm_add_epi8(shuffle1, _mm_set1_epi8(shift0));
-  const uint8_t shift1 = patterns[key1].shift;
-
-  *shuffle = _mm_unpacklo_epi64(shuffle0, shuffle1);
-  *bytes += patterns[key0].bytes + patterns[key1].bytes;
-
-  return (patterns[key0].shift + patterns[key1].shift) &
-    (((mask0 != patterns[key0].mask) | (mask1 != patterns[key1].mask)) - 1u);
+  char text[2 * IP6_PADDING] = { 0 };
+  memcpy(text, src, len < IP6_PADDING ? len : IP6_PADDING);
+  struct ip6_window window;
+  ip6_classify(&window, text);
+  return ip6_parse(text, dst, &window);
 }
 
-__attribute__((noinline))
-size_t parse_ip6(const char *src, void *dst)
+// the parser reads at most IP6_PADDING bytes from src. reading past len is
+// safe if those bytes are on the same page as the last byte of the input.
+// the bytes past len do not affect the result if the address ends within
+// len, a result of 0 may be caused by them however
+size_t parse_ip6_bounded_sse41(const char *src, size_t len, void *dst)
 {
-  const __m128i delta_check = _mm_setr_epi8(
-    -16, -32, -47, 71, 58, -96, 26, -128, 0, 0, 0, 0, 0, 0, 0, 0);
-  const __m128i delta_rebase = _mm_setr_epi8(
-    0, 0, -47, -47, -54, 0, -86, 0, 0, 0, 0, 0, 0, 0, 0, 0);
-
-  __m128i input = _mm_loadu_si128((__m128i*)src);
-  uint64_t colons = (uint16_t)_mm_movemask_epi8(
-    _mm_cmpeq_epi8(input, _mm_set1_epi8(':')));
-
-  // Leading :: requires sepcial handling.
-  // :: is allowed, as is abcd:, but not :abcd.
-  if (unlikely((colons & 3llu) == 1llu))
+  if (unlikely(!len))
     return 0u;
 
-  // TODO: Describe the reasoning behind -1 (credit @aqrit).
-  input = _mm_add_epi8(input, _mm_set1_epi8(-1));
-  __m128i keys = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0f));
-
-  uint64_t non_digits = (uint16_t)_mm_movemask_epi8(
-    _mm_add_epi8(_mm_shuffle_epi8(delta_check, keys), input));
-  input = _mm_add_epi8(input, _mm_shuffle_epi8(delta_rebase, keys));
-
-  uint64_t mask;
-  uint64_t delimiter = first_trailing_one(non_digits ^ colons);
-  colons &= (delimiter - 1llu);
-  mask = colons;
-  colons |= delimiter;
-
-  __m128i shuffle;
-  uint32_t size, shift, bytes = 0;
-  if (!(shift = load_shuffle_mask(&shuffle, &bytes, colons)))
-    return 0u;
-
-  input = _mm_shuffle_epi8(input, shuffle);
-  input = _mm_maddubs_epi16(input, _mm_set1_epi16(0x0110));
-  input = _mm_packus_epi16(input, input);
-  _mm_storeu_si128((__m128i *)dst, input);
-
-  size = shift;
-  colons >>= shift;
-
-  while (bytes < 16 && !(delimiter && !colons)) {
-    input = _mm_loadu_si128((__m128i*)(src + size));
-    colons = (uint16_t)_mm_movemask_epi8(
-      _mm_cmpeq_epi8(input, _mm_set1_epi8(':')));
-
-    input = _mm_add_epi8(input, _mm_set1_epi8(-1));
-    keys = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0f));
-    non_digits = (uint16_t)_mm_movemask_epi8(
-      _mm_add_epi8(_mm_shuffle_epi8(delta_check, keys), input));
-    input = _mm_add_epi8(input, _mm_shuffle_epi8(delta_rebase, keys));
-
-    delimiter = first_trailing_one(non_digits ^ colons);
-    colons &= delimiter - 1;
-    mask |= (colons << size);
-    colons |= delimiter;
-
-    uint8_t *out = (uint8_t*)dst + bytes;
-    if (!(shift = load_shuffle_mask(&shuffle, &bytes, colons)))
+  const uintptr_t last = (uintptr_t)src + len - 1;
+  const uintptr_t limit = (uintptr_t)src + IP6_PADDING - 1;
+  if (likely(len >= IP6_PADDING || !((last ^ limit) >> 12))) {
+    struct ip6_window window;
+    ip6_classify(&window, src);
+    const size_t size = ip6_parse(src, dst, &window);
+    if (likely(size && size <= len))
+      return size;
+    if (len >= IP6_PADDING)
       return 0u;
-    size += shift;
-    colons >>= shift;
-
-    input = _mm_shuffle_epi8(input, shuffle);
-    input = _mm_maddubs_epi16(input, _mm_set1_epi16(0x0110));
-    input = _mm_packus_epi16(input, input);
-    _mm_storeu_si128((__m128i *)out, input);
   }
 
-  size -= 1u; // Account for delimiter.
-  assert(size <= INET6_ADDRSTRLEN);
+  return parse_copy(src, len, dst);
+}
 
-  // TODO: support for IPv4 embedded IPv6 addresses.
-  if (unlikely(src[size] == ':' || src[size] == '.'))
-    return 0u;
+// space, tab, carriage return and newline separate records, text at or past
+// end counts as whitespace
+__attribute__((always_inline))
+static inline uint32_t whitespace(const struct ip6_window *window, const char *end)
+{
+  const __m128i spaces = _mm_setr_epi8(
+    ' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0);
+  const uint32_t mask = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+    _mm_shuffle_epi8(spaces, window->text), window->text));
+  const size_t size = (size_t)(end - window->base);
+  return size < 16 ? mask | ((0xffffu << size) & 0xffffu) : mask;
+}
 
-  uint64_t compressed = (mask << 1) & mask;
-  if (compressed) {
-    if ((count_ones(compressed) > 1) || (bytes > 14))
-      return 0u;
-    printf("todo, implement final shift\n");
+// move to the first byte at or after cursor that is (or is not) whitespace,
+// the window is reloaded only if cursor is not within it
+__attribute__((always_inline))
+static inline const char *skip(
+  struct ip6_window *window, const char *cursor, const char *end, uint32_t spaces)
+{
+  for (; cursor < end; cursor = window->base + 16) {
+    if ((size_t)(cursor - window->base) >= 16)
+      ip6_classify(window, cursor);
+    const uint32_t offset = (uint32_t)(cursor - window->base);
+    const uint32_t mask =
+      ((whitespace(window, end) ^ (spaces - 1u)) & 0xffffu) >> offset;
+    if (mask)
+      return cursor + trailing_zeros(mask);
   }
-
-  if (bytes != 16)
-    return 0u;
-
-  return size;
+  return end;
 }
 
-int main(int argc, char *argv[])
+// parse whitespace separated addresses in src. at least 16 bytes past len
+// must be readable and consist of whitespace or null bytes. addresses are
+// written to dst densely, status receives the length of each record, or 0 if
+// the record is not a valid address. returns the number of records, consumed
+// receives the offset past the last record, or len if no records remain, from
+// which the next call continues if parsing stopped at count records.
+// the buffer is walked with the classified window of the parser, the window
+// left by one record is reused for the next if it starts within it
+size_t parse_ip6_batch(
+  const char *src, size_t len, uint8_t (*dst)[16], uint8_t *status, size_t count,
+  size_t *consumed)
 {
-  if (argc != 2)
-    return 1;
-
-  char str[64] = { 0 };
-  uint8_t addr[64];
-  size_t size = strlen(argv[1]);
-  if (size > 63)
-    size = 63;
-  memcpy(str, argv[1], size);
-  printf("input: %s\n", str);
-  size_t len = parse_ip6(str, addr);
-  printf("length: %zu\n", len);
-
-  printf("address: { ");
-  for (size_t i=0; i < 15; i++)
-    printf("%d, ", addr[i]);
-  printf("%d }\n", addr[15]);
+  const char *end = src + len, *cursor = src;
+  struct ip6_window window;
+  uint8_t last[32];
+  size_t records = 0;
+
+  ip6_classify(&window, src);
+  for (; records < count; records++) {
+    const char *start = skip(&window, cursor, end, 0u);
+    if (start == end) {
+      cursor = end;
+      break;
+    }
+
+    // the parser requires the first group and its delimiter in the window
+    if ((size_t)(start - window.base) > 11)
+      ip6_classify(&window, start);
+    // the final store may exceed the address by up to 16 bytes, which is
+    // harmless for all but the last record
+    uint8_t *out = records + 1 < count ? dst[records] : last;
+    const size_t size = ip6_parse(start, out, &window);
+    if (out == last)
+      memcpy(dst[records], last, 16);
+
+    // the window holds the delimiter unless the address ends in a quad
+    cursor = skip(&window, start + size, end, 1u);
+    status[records] = size && cursor == start + size ? (uint8_t)size : 0u;
+  }
 
-  return 0;
+  *consumed = (size_t)(cursor - src);
+  return records;
 }
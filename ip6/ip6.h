@@ -0,0 +1,162 @@
+/*
+ * ip6.h -- vectorized parsers and formatter for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef IP6_H
+#define IP6_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the library is built with hidden visibility, only these are exported
+#define IP6_EXPORT __attribute__((visibility("default")))
+
+// parsers may read up to IP6_PADDING bytes past the delimiter and may write
+// up to 32 bytes to dst
+#define IP6_PADDING (64)
+
+// parse address at src into dst, returns the length of the address, or 0 if
+// src does not start with a valid address. dispatches to the widest engine
+// the CPU supports when the program is loaded
+IP6_EXPORT size_t parse_ip6(const char *src, void *dst);
+
+// parse address in the first len bytes at src into dst. never reads from a
+// page that holds none of those bytes, src therefore requires no padding
+IP6_EXPORT size_t parse_ip6_bounded(const char *src, size_t len, void *dst);
+
+// name of the engine parse_ip6 and parse_ip6_bounded dispatch to, one of
+// "avx512", "avx2", "sse41" or "scalar". all other functions require
+// SSE 4.1, POPCNT, BMI1 and LZCNT, i.e. an engine other than "scalar"
+IP6_EXPORT const char *parse_ip6_engine(void);
+
+// requires SSE 4.1, POPCNT, BMI1 and LZCNT
+IP6_EXPORT size_t parse_ip6_sse41(const char *src, void *dst);
+IP6_EXPORT size_t parse_ip6_bounded_sse41(
+  const char *src, size_t len, void *dst);
+
+// parse address and prefix length (e.g. 2001:db8::/32) at src into dst and
+// prefix, returns the length including the prefix length, or 0 if src does not
+// start with a valid prefix. bits past the prefix length are not checked
+IP6_EXPORT size_t parse_ip6_prefix(const char *src, void *dst, uint8_t *prefix);
+
+IP6_EXPORT size_t parse_ip6_batch(
+  const char *src, size_t len, uint8_t (*dst)[16], uint8_t *status, size_t count,
+  size_t *consumed);
+
+typedef struct ip6_match ip6_match_t;
+struct ip6_match { size_t offset; size_t length; uint8_t address[16]; };
+
+// find addresses in free text, e.g. logs, returns the number of matches
+// written to matches. an address must not directly follow or precede a
+// letter, digit or underscore, nor follow a dot, a trailing dot is dropped.
+// MAC addresses and times are therefore not matched, EUI-64 identifiers
+// written as eight groups are indistinguishable from addresses. scanning
+// stops after count matches, continue from the end of the last. src requires
+// no padding
+IP6_EXPORT size_t scan_ip6(
+  const char *src, size_t len, ip6_match_t *matches, size_t count);
+
+// reverse names under ip6.arpa, e.g. 1.0.0.0.[...].8.b.d.0.1.0.0.2.ip6.arpa.
+// for 2001:db8::1. prefix is the number of leading bits the name covers, 128
+// for a PTR name or less for a zone cut, and must be a multiple of 4. dst must
+// have room for IP6_ARPA_SIZE bytes, the functions return 0 for an invalid
+// prefix
+#define IP6_ARPA_SIZE (80)
+
+// write the name as text, returns the length excluding the terminating null
+// byte (73 for all 128 bits)
+IP6_EXPORT size_t format_ip6_arpa(const void *src, uint32_t prefix, char *dst);
+
+// write the name in DNS wire format, returns the length including the root
+// label (74 for all 128 bits)
+IP6_EXPORT size_t format_ip6_arpa_wire(
+  const void *src, uint32_t prefix, uint8_t *dst);
+
+// write names for count addresses, in text each is followed by a newline, in
+// wire format the names are consecutive. dst must have room for
+// IP6_ARPA_SIZE bytes per address, returns the number of bytes written
+IP6_EXPORT size_t format_ip6_arpa_batch(
+  const uint8_t (*src)[16], size_t count, uint32_t prefix, char *dst);
+IP6_EXPORT size_t format_ip6_arpa_wire_batch(
+  const uint8_t (*src)[16], size_t count, uint32_t prefix, uint8_t *dst);
+
+// longest prefix match table, built once from routes, e.g. as parsed by
+// parse_ip6_prefix. values must be below IP6_LPM_NONE
+#define IP6_LPM_NONE (0x7fffffffu)
+
+typedef struct ip6_lpm ip6_lpm_t;
+typedef struct ip6_route ip6_route_t;
+struct ip6_route { uint8_t address[16]; uint8_t length; uint32_t value; };
+
+// build table from count routes, bits past the prefix length are ignored and
+// the last of duplicate prefixes wins. returns NULL with errno set to EINVAL
+// for an invalid route or ENOMEM if out of memory
+IP6_EXPORT ip6_lpm_t *ip6_lpm_build(const ip6_route_t *routes, size_t count);
+IP6_EXPORT void ip6_lpm_free(ip6_lpm_t *lpm);
+
+// size of the table in bytes
+IP6_EXPORT size_t ip6_lpm_size(const ip6_lpm_t *lpm);
+
+// value of the longest prefix that matches the address (16 bytes), or
+// IP6_LPM_NONE if no prefix matches
+IP6_EXPORT uint32_t ip6_lpm_lookup(const ip6_lpm_t *lpm, const void *address);
+
+// look up count addresses into values, overlaps the cache misses of
+// independent lookups
+IP6_EXPORT void ip6_lpm_lookup_batch(
+  const ip6_lpm_t *lpm, const uint8_t (*addresses)[16], size_t count, uint32_t *values);
+
+// requires AVX2, POPCNT, BMI1 and LZCNT
+IP6_EXPORT size_t parse_ip6_avx2(const char *src, void *dst);
+
+// requires AVX512BW, AVX512VL, AVX512_VBMI and AVX512_VBMI2
+IP6_EXPORT size_t parse_ip6_avx512(const char *src, void *dst);
+
+// scalar reference, reads no further than the delimiter
+IP6_EXPORT size_t parse_ip6_scalar(const char *src, void *dst);
+
+// parse dotted quad at src into dst (4 bytes), returns the length of the
+// address, or 0 if src does not start with a valid address
+IP6_EXPORT size_t parse_ip4(const char *src, void *dst);
+
+// format address at src as canonical text (RFC 5952) into dst, returns the
+// length excluding the terminating null byte. dst must have room for
+// IP6_PADDING bytes
+IP6_EXPORT size_t format_ip6(const void *src, char *dst);
+
+// format count addresses into dst, each terminated by a newline, returns the
+// number of bytes written. dst must have room for 40 bytes per address plus
+// IP6_PADDING bytes
+IP6_EXPORT size_t format_ip6_batch(
+  const uint8_t (*src)[16], size_t count, char *dst);
+
+// counters of the SSE 4.1 and AVX2 parsers, compiled in if the library is
+// configured with -DIP6_STATS=ON (see stats.h). parse_ip6 does not dispatch
+// to AVX-512 in that case, which has no pattern table
+#if defined(IP6_STATS)
+#include <stdio.h>
+#include "stats.h"
+
+// add the counters of the calling thread to stats and reset them
+IP6_EXPORT void ip6_stats_collect(ip6_stats_t *stats);
+
+// write stats as text, one counter per line. lookups are listed per pattern
+// id with its mask in the notation of patterns.h, and per key of groups.h
+// with the widths of the four groups, returns 0 on success or -1 on a write
+// error
+IP6_EXPORT int ip6_stats_dump(FILE *file, const ip6_stats_t *stats);
+#endif
+
+// define IP6_HEADER_ONLY for parse_ip6_inline and parse_ip6_prefix_inline,
+// which inline into the caller. the caller must be compiled with SSE 4.1,
+// POPCNT, BMI1 and LZCNT enabled and the generated tables must be on the
+// include path
+#if defined(IP6_HEADER_ONLY)
+#include "sse41.h"
+#endif
+
+#endif // IP6_H
@@ -0,0 +1,71 @@
+/*
+ * latency.c -- latency of the pattern lookups of the SSE 4.1 parser
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "sse41.h"
+#include "latency.h"
+
+// the window of an address is classified only once the previous lookup
+// returned the shift, lookups are chained the same way here. the index of the
+// next mask depends on the shift, which is never large enough to change it
+
+#define CHAIN(lookup) \
+  do { \
+    uint32_t index = 0, sink = 0; \
+    const uint64_t start = __rdtsc(); \
+    for (size_t i = 0; i < count; i++) { \
+      __m128i shuffle; \
+      uint32_t bytes = 0; \
+      const uint32_t shift = lookup(&shuffle, &bytes, masks[index]); \
+      index = (uint32_t)(i + 1) + (shift >> 8); \
+      sink += bytes + (uint32_t)_mm_cvtsi128_si32(shuffle); \
+    } \
+    const uint64_t cycles = __rdtsc() - start; \
+    if (!pass || cycles < best[variant]) \
+      best[variant] = cycles; \
+    sinks += sink; \
+    variant++; \
+  } while (0)
+
+void measure_patterns(const char *texts, size_t stride, size_t count)
+{
+  uint32_t *masks;
+  if (!(masks = malloc((count + 1) * sizeof(*masks))))
+    return;
+
+  // delimiters in the first window as ip6_parse computes them
+  for (size_t i = 0; i < count; i++) {
+    struct ip6_window window;
+    ip6_classify(&window, texts + i * stride);
+    const uint64_t delimiter =
+      first_trailing_one(window.non_digits ^ window.colons);
+    masks[i] = (uint32_t)((window.colons & (delimiter - 1llu)) | delimiter);
+  }
+  masks[count] = 0;
+
+  uint64_t best[4] = { 0, 0, 0, 0 };
+  volatile uint32_t sinks = 0;
+  for (uint32_t pass = 0; pass < 5; pass++) {
+    uint32_t variant = 0;
+    CHAIN(ip6_load_shuffle_mask_split);
+    CHAIN(ip6_load_shuffle_mask_fused);
+    CHAIN(ip6_load_shuffle_mask_paired);
+    CHAIN(ip6_load_shuffle_mask_widths);
+  }
+
+  static const char *names[4] = { "split", "fused", "paired", "widths" };
+  for (uint32_t variant = 0; variant < 4; variant++)
+    printf("%-30s\t: %.1f cycles/lookup%s\n",
+      names[variant], (double)best[variant] / (double)count,
+      variant == IP6_PATTERNS ? " (selected)" : "");
+  free(masks);
+}
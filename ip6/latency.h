@@ -0,0 +1,18 @@
+/*
+ * latency.h -- latency of the pattern lookups of the SSE 4.1 parser
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+
+// report cycles per lookup for each variant of ip6_load_shuffle_mask on the
+// first window of count texts, stride bytes apart
+void measure_patterns(const char *texts, size_t stride, size_t count);
+
+#endif // LATENCY_H
@@ -0,0 +1,366 @@
+/*
+ * lpm.c -- longest prefix match for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ip6.h"
+#include "bits.h"
+
+// multibit trie with a 16-bit first stride and 8-bit strides after that. an
+// entry is either a value or, if the top bit is set, the offset of a node.
+// prefixes are expanded to the stride (controlled prefix expansion) and
+// values are pushed down into new nodes (leaf pushing), a lookup therefore
+// stops at the first entry that is a value and takes at most 15 strides.
+//
+// a node covers 256 entries, but after leaf pushing most are repeats of the
+// entry before. nodes are therefore stored compressed, a bitmap marks the
+// entries that differ from the one before and only those are stored. the
+// entry for a key is found by the number of bits set up to and including
+// the key (bitmap and popcount), a count per 64-bit word of the bitmap
+// limits that to a single popcount. the entries directly follow the bitmap,
+// the entry is therefore usually in the cache line the bitmap was read from.
+//
+// the trie is built one root entry at a time. routes are sorted by root
+// entry and inserted shortest first into an expanded trie, so that a prefix
+// never covers an existing node. the expanded trie is then compressed and
+// reused for the next root entry
+
+#define CHILD (0x80000000u)
+#define ROOT_BITS (16u)
+#define NODE_BITS (8u)
+#define NODE_SIZE (1u << NODE_BITS)
+
+typedef struct node node_t;
+struct node { uint64_t bitmap[4]; uint8_t counts[4]; uint32_t entries[]; };
+
+// nodes are addressed by offset in 8-byte words
+#define NODE_WORDS(size) \
+  ((offsetof(node_t, entries) + (size) * sizeof(uint32_t) + 7) / 8)
+
+struct ip6_lpm {
+  uint32_t root[1u << ROOT_BITS];
+  uint64_t *nodes;
+  size_t count, capacity;
+};
+
+// expanded nodes of the root entry that is being built
+typedef struct trie trie_t;
+struct trie { uint32_t *nodes; size_t count, capacity; };
+
+typedef struct route_order route_order_t;
+struct route_order { const ip6_route_t *route; size_t index; };
+
+// routes of up to 16 bits go in the root, the others are grouped by entry
+static uint32_t root_of(const ip6_route_t *route)
+{
+  if (route->length <= ROOT_BITS)
+    return 0u;
+  return 1u + (((uint32_t)route->address[0] << 8) | route->address[1]);
+}
+
+static int compare_routes(const void *a, const void *b)
+{
+  const route_order_t *x = a, *y = b;
+  const uint32_t root_x = root_of(x->route), root_y = root_of(y->route);
+  if (root_x != root_y)
+    return root_x < root_y ? -1 : 1;
+  if (x->route->length != y->route->length)
+    return x->route->length < y->route->length ? -1 : 1;
+  // later routes for the same prefix win
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// allocate an expanded node with every entry set to the value it replaces
+static uint32_t add_node(trie_t *trie, uint32_t value)
+{
+  if (trie->count == trie->capacity) {
+    const size_t capacity = trie->capacity ? 2 * trie->capacity : 64;
+    if (capacity >= CHILD)
+      return 0u;
+    uint32_t *nodes = realloc(trie->nodes, capacity * NODE_SIZE * sizeof(*nodes));
+    if (!nodes)
+      return 0u;
+    trie->nodes = nodes;
+    trie->capacity = capacity;
+  }
+
+  uint32_t *node = trie->nodes + trie->count * NODE_SIZE;
+  for (uint32_t i = 0; i < NODE_SIZE; i++)
+    node[i] = value;
+  return CHILD | (uint32_t)trie->count++;
+}
+
+// insert a route of more than 16 bits below the root entry at top
+static int insert(trie_t *trie, uint32_t *top, const ip6_route_t *route)
+{
+  const uint8_t *address = route->address;
+  const uint32_t length = route->length;
+
+  // walk down to the node the prefix expands into. entries are addressed by
+  // node and index as adding a node may move the others
+  uint32_t node = 0, index = 0;
+  uint32_t bits = ROOT_BITS;
+  for (uint32_t octet = 2; length > bits; octet++) {
+    uint32_t *entry = node ? &trie->nodes[(size_t)(node & ~CHILD) * NODE_SIZE + index]
+                           : top;
+    if (!(*entry & CHILD)) {
+      const uint32_t child = add_node(trie, *entry);
+      if (!child)
+        return -1;
+      entry = node ? &trie->nodes[(size_t)(node & ~CHILD) * NODE_SIZE + index]
+                   : top;
+      *entry = child;
+    }
+    node = *entry;
+    index = address[octet];
+    bits += NODE_BITS;
+  }
+
+  uint32_t *entries = &trie->nodes[(size_t)(node & ~CHILD) * NODE_SIZE];
+  const uint32_t span = 1u << (bits - length);
+  index &= ~(span - 1u);
+  for (uint32_t i = 0; i < span; i++)
+    entries[index + i] = route->value;
+  return 0;
+}
+
+// reserve a compressed node with size entries, returns its offset
+static size_t add_compressed(ip6_lpm_t *lpm, size_t size)
+{
+  const size_t words = NODE_WORDS(size);
+  if (lpm->capacity - lpm->count < words) {
+    size_t capacity = lpm->capacity ? lpm->capacity : 4096;
+    while (capacity - lpm->count < words)
+      capacity *= 2;
+    if (capacity > CHILD)
+      return SIZE_MAX;
+    uint64_t *nodes = realloc(lpm->nodes, capacity * sizeof(*nodes));
+    if (!nodes)
+      return SIZE_MAX;
+    lpm->nodes = nodes;
+    lpm->capacity = capacity;
+  }
+
+  const size_t offset = lpm->count;
+  lpm->count += words;
+  return offset;
+}
+
+// compress the expanded node an entry refers to and the nodes below it
+static int compress(ip6_lpm_t *lpm, const trie_t *trie, uint32_t *entry)
+{
+  if (!(*entry & CHILD))
+    return 0;
+
+  const uint32_t *expanded = &trie->nodes[(size_t)(*entry & ~CHILD) * NODE_SIZE];
+  size_t size = 1;
+  for (uint32_t i = 1; i < NODE_SIZE; i++)
+    size += expanded[i] != expanded[i - 1];
+
+  // nodes below are added after, the node is addressed by offset as adding
+  // them may move it
+  const size_t offset = add_compressed(lpm, size);
+  if (offset == SIZE_MAX)
+    return -1;
+  uint64_t bitmap[4] = { 0 };
+  size = 0;
+  for (uint32_t i = 0; i < NODE_SIZE; i++) {
+    if (i && expanded[i] == expanded[i - 1])
+      continue;
+    bitmap[i / 64] |= 1llu << (i % 64);
+    uint32_t child = expanded[i];
+    if (compress(lpm, trie, &child) != 0)
+      return -1;
+    ((node_t *)&lpm->nodes[offset])->entries[size++] = child;
+  }
+
+  node_t *node = (node_t *)&lpm->nodes[offset];
+  for (uint32_t i = 0, count = 0; i < 4; i++) {
+    node->bitmap[i] = bitmap[i];
+    node->counts[i] = (uint8_t)count;
+    count += (uint32_t)count_ones(bitmap[i]);
+  }
+  *entry = CHILD | (uint32_t)offset;
+  return 0;
+}
+
+ip6_lpm_t *ip6_lpm_build(const ip6_route_t *routes, size_t count)
+{
+  ip6_lpm_t *lpm;
+  route_order_t *order;
+  if (!(lpm = calloc(1, sizeof(*lpm))))
+    return NULL;
+  if (!(order = calloc(count ? count : 1, sizeof(*order)))) {
+    free(lpm);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (routes[i].length > 128 || routes[i].value >= IP6_LPM_NONE) {
+      free(order);
+      free(lpm);
+      errno = EINVAL;
+      return NULL;
+    }
+    order[i] = (route_order_t){ &routes[i], i };
+  }
+  qsort(order, count, sizeof(*order), compare_routes);
+
+  for (uint32_t i = 0; i < (1u << ROOT_BITS); i++)
+    lpm->root[i] = IP6_LPM_NONE;
+
+  size_t next = 0;
+  for (; next < count && !root_of(order[next].route); next++) {
+    const ip6_route_t *route = order[next].route;
+    const uint32_t span = 1u << (ROOT_BITS - route->length);
+    const uint32_t index =
+      (((uint32_t)route->address[0] << 8) | route->address[1]) & ~(span - 1u);
+    for (uint32_t i = 0; i < span; i++)
+      lpm->root[index + i] = route->value;
+  }
+
+  trie_t trie = { NULL, 0, 0 };
+  while (next < count) {
+    const uint32_t root = root_of(order[next].route);
+    uint32_t *top = &lpm->root[root - 1];
+    trie.count = 0;
+    for (; next < count && root_of(order[next].route) == root; next++)
+      if (insert(&trie, top, order[next].route) != 0)
+        goto no_memory;
+    if (compress(lpm, &trie, top) != 0)
+      goto no_memory;
+  }
+
+  free(trie.nodes);
+  free(order);
+  return lpm;
+no_memory:
+  free(trie.nodes);
+  free(order);
+  ip6_lpm_free(lpm);
+  errno = ENOMEM;
+  return NULL;
+}
+
+void ip6_lpm_free(ip6_lpm_t *lpm)
+{
+  if (!lpm)
+    return;
+  free(lpm->nodes);
+  free(lpm);
+}
+
+size_t ip6_lpm_size(const ip6_lpm_t *lpm)
+{
+  return sizeof(*lpm) + lpm->count * sizeof(*lpm->nodes);
+}
+
+#define node_at(lpm, entry) ((const node_t *)&(lpm)->nodes[(entry) & ~CHILD])
+
+// entry for key in a compressed node, the number of entries that differ
+// from the one before up to and including key
+__attribute__((always_inline))
+static inline const uint32_t *rank(const node_t *node, uint32_t key)
+{
+  const uint64_t bits = node->bitmap[key / 64] << (63 - key % 64);
+  return &node->entries[node->counts[key / 64] + count_ones(bits) - 1];
+}
+
+uint32_t ip6_lpm_lookup(const ip6_lpm_t *lpm, const void *address)
+{
+  const uint8_t *octets = address;
+  uint32_t entry = lpm->root[((uint32_t)octets[0] << 8) | octets[1]];
+  for (uint32_t octet = 2; entry & CHILD; octet++)
+    entry = *rank(node_at(lpm, entry), octets[octet]);
+  return entry;
+}
+
+// addresses are looked up in two groups that take turns, one stride at a
+// time. a group loads the entries of its addresses and prefetches the nodes
+// they refer to, the loads of the other group are then issued before the
+// group reads those nodes. prefetches are therefore a full group ahead
+#define GROUP (16u)
+
+typedef struct group group_t;
+struct group {
+  const uint8_t (*addresses)[16];
+  uint32_t *values;
+  uint32_t octet, pending;
+  uint8_t lanes[GROUP];
+  const node_t *nodes[GROUP];
+};
+
+// start a group at the root entries of size addresses
+__attribute__((always_inline))
+static inline void start_group(
+  const ip6_lpm_t *lpm, const uint8_t (*addresses)[16], uint32_t *values,
+  size_t size, group_t *group)
+{
+  group->addresses = addresses;
+  group->values = values;
+  group->octet = 2;
+  group->pending = (uint32_t)size;
+  for (uint32_t i = 0; i < size; i++) {
+    group->lanes[i] = (uint8_t)i;
+    __builtin_prefetch(&lpm->root[((uint32_t)addresses[i][0] << 8) | addresses[i][1]]);
+  }
+}
+
+// take one stride for the addresses in a group that have not found a value
+__attribute__((always_inline))
+static inline void step_group(const ip6_lpm_t *lpm, group_t *group)
+{
+  const uint32_t octet = group->octet++;
+  uint32_t pending = 0;
+  for (uint32_t j = 0; j < group->pending; j++) {
+    const uint32_t i = group->lanes[j];
+    const uint8_t *octets = group->addresses[i];
+    // the entry is usually in the lines prefetched with the bitmap
+    const uint32_t entry = octet == 2
+      ? lpm->root[((uint32_t)octets[0] << 8) | octets[1]]
+      : *rank(group->nodes[i], octets[octet - 1]);
+    group->values[i] = entry;
+    if (entry & CHILD) {
+      const node_t *node = node_at(lpm, entry);
+      __builtin_prefetch(&node->bitmap[octets[octet] / 64]);
+      __builtin_prefetch(&node->entries[0]);
+      group->nodes[i] = node;
+      group->lanes[pending++] = (uint8_t)i;
+    }
+  }
+  group->pending = pending;
+}
+
+void ip6_lpm_lookup_batch(
+  const ip6_lpm_t *lpm, const uint8_t (*addresses)[16], size_t count, uint32_t *values)
+{
+  group_t groups[2];
+  size_t next = 0;
+
+  for (uint32_t g = 0; g < 2; g++) {
+    const size_t size = count - next < GROUP ? count - next : GROUP;
+    start_group(lpm, addresses + next, values + next, size, &groups[g]);
+    next += size;
+  }
+
+  while (groups[0].pending || groups[1].pending) {
+    for (uint32_t g = 0; g < 2; g++) {
+      if (groups[g].pending)
+        step_group(lpm, &groups[g]);
+      if (!groups[g].pending && next < count) {
+        const size_t size = count - next < GROUP ? count - next : GROUP;
+        start_group(lpm, addresses + next, values + next, size, &groups[g]);
+        next += size;
+      }
+    }
+  }
+}
@@ -0,0 +1,110 @@
+/*
+ * main.c -- parse IPv6 addresses given on the command line or in a file
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ip6.h"
+#include "ingest.h"
+
+static void usage(const char *program)
+{
+#if defined(IP6_STATS)
+  fprintf(stderr, "Usage: %s ADDRESS | -f INPUT [-o OUTPUT] [-r REJECTS] [-s STATS] [-j THREADS]\n", program);
+#else
+  fprintf(stderr, "Usage: %s ADDRESS | -f INPUT [-o OUTPUT] [-r REJECTS] [-j THREADS]\n", program);
+#endif
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  -f INPUT    parse INPUT, one address per line\n");
+  fprintf(stderr, "  -o OUTPUT   write valid addresses to OUTPUT, 16 bytes each\n");
+  fprintf(stderr, "  -r REJECTS  write line number and text of rejected lines to REJECTS\n");
+#if defined(IP6_STATS)
+  fprintf(stderr, "  -s STATS    write counters of the parsers to STATS\n");
+#endif
+  fprintf(stderr, "  -j THREADS  number of threads (default: number of processors)\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *program = argv[0];
+  const char *input = NULL, *output = NULL, *rejects = NULL, *stats = NULL;
+  // sysconf returns -1 if the count is unavailable
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  else if (threads > 1024)
+    threads = 1024;
+
+  int option;
+#if defined(IP6_STATS)
+  const char *options = "f:o:r:s:j:";
+#else
+  const char *options = "f:o:r:j:";
+#endif
+  while ((option = getopt(argc, argv, options)) != -1) {
+    switch (option) {
+      case 'f':
+        input = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'r':
+        rejects = optarg;
+        break;
+      case 's':
+        stats = optarg;
+        break;
+      case 'j': {
+        char *end = NULL;
+        errno = 0;
+        threads = strtol(optarg, &end, 10);
+        if (errno || end == optarg || *end || threads < 1 || threads > 1024)
+          usage(program);
+        break;
+      }
+      default:
+        usage(program);
+    }
+  }
+
+  if (input) {
+    if (optind != argc)
+      usage(program);
+    return ingest(input, output, rejects, stats, (uint32_t)threads);
+  }
+
+  if (output || rejects || stats || argc - optind != 1)
+    usage(program);
+  const char *address = argv[optind];
+
+  uint8_t addr[64];
+  printf("input: %s\n", address);
+  size_t len = parse_ip6_bounded(address, strlen(address), addr);
+  printf("length: %zu\n", len);
+  printf("engine: %s\n", parse_ip6_engine());
+
+  printf("address: { ");
+  for (size_t i=0; i < 15; i++)
+    printf("%d, ", addr[i]);
+  printf("%d }\n", addr[15]);
+
+  // the formatter requires SSE 4.1
+  if (len && strcmp(parse_ip6_engine(), "scalar") != 0) {
+    char text[IP6_PADDING];
+    format_ip6(addr, text);
+    printf("canonical: %s\n", text);
+  }
+
+  return 0;
+}
@@ -8,12 +8,17 @@
  */
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <unistd.h>
 #include <immintrin.h>
 
+#include "corpus.h"
+
 #define BITS (16)
 
 #define MASK_BITS (9)
@@ -48,21 +53,411 @@ static void permutate(
   }
 }
 
+// shuffle to expand :: given the group that is compressed and the number of
+// bytes parsed, which includes the empty group. groups before :: stay in
+// place, groups after :: move to the end
+static int write_expansions(const char *path)
+{
+  FILE *file;
+  if (!(file = fopen(path, "w")))
+    return EXIT_FAILURE;
 
-int main(int argc, char *argv[])
+  fprintf(file, "/*\n * expansions.h -- shuffles to expand compressed groups\n *\n");
+  fprintf(file, " * generated by perm, do not edit\n *\n */\n");
+  fprintf(file, "#ifndef EXPANSIONS_H\n#define EXPANSIONS_H\n\n#include <stdint.h>\n\n");
+  fprintf(file, "// shuffle to expand :: given the group that is compressed and the number\n");
+  fprintf(file, "// of bytes parsed (/ 2), identity for combinations that do not occur\n");
+  fprintf(file, "static const uint8_t expansions[8][9][16] __attribute__((aligned(16))) = {\n");
+  for (uint32_t group=0; group < 8; group++) {
+    fprintf(file, "  {\n");
+    for (uint32_t bytes=0; bytes <= 16; bytes += 2) {
+      const uint32_t trailing = 16 - (bytes - 2 * group - 2);
+      fprintf(file, "    {");
+      for (uint32_t i=0; i < 16; i++) {
+        uint32_t index = i;
+        if (bytes > 2 * group && bytes < 16 && i >= 2 * group)
+          index = i >= trailing ? i - (16 - bytes) : 128;
+        fprintf(file, "%s%3u", i ? ", " : " ", index);
+      }
+      fprintf(file, " }%s // %u, %2u\n", bytes < 16 ? "," : " ", group, bytes);
+    }
+    fprintf(file, "  }%s\n", group < 7 ? "," : "");
+  }
+  fprintf(file, "};\n\n#endif // EXPANSIONS_H\n");
+
+  return fclose(file) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// shuffles for the formatter, which writes two groups at a time. the state
+// of a group is the number of leading zeros dropped (0-3), the first group of
+// the compressed run (4, written as a single colon) or any other group in the
+// run (5, not written). digits of the first group are 0-3, those of the
+// second 4-7, colons are 128
+static int write_pieces(const char *path)
 {
-  char *str = "", *end = str;
+  static const char *states[6] = { "0", "1", "2", "3", "::", "-" };
+  FILE *file;
+  if (!(file = fopen(path, "w")))
+    return EXIT_FAILURE;
 
-  if (argc > 1)
-    str = argv[1];
+  fprintf(file, "/*\n * pieces.h -- shuffles to format two consecutive groups\n *\n");
+  fprintf(file, " * generated by perm, do not edit\n *\n */\n");
+  fprintf(file, "#ifndef PIECES_H\n#define PIECES_H\n\n#include <stdint.h>\n\n");
+  fprintf(file, "// shuffle and length by state of the second group * 6 + that of the first\n");
+  fprintf(file, "static const struct {\n  uint8_t length;\n  uint8_t shuffle[16];\n} pieces[36] = {\n");
+  for (uint32_t piece=0; piece < 36; piece++) {
+    const uint32_t groups[2] = { piece % 6, piece / 6 };
+    uint8_t shuffle[16];
+    uint32_t length = 0;
+    memset(shuffle, 128, sizeof(shuffle));
+    for (uint32_t group=0; group < 2; group++) {
+      if (groups[group] > 4)
+        continue;
+      for (uint32_t digit=groups[group]; digit < 4; digit++)
+        shuffle[length++] = (uint8_t)(4 * group + digit);
+      length++;
+    }
+    fprintf(file, "  { %2u, {", length);
+    for (uint32_t i=0; i < 16; i++)
+      fprintf(file, "%s%3u", i ? ", " : " ", shuffle[i]);
+    fprintf(file, " } }%s // %2u: %s, %s\n", piece < 35 ? "," : " ",
+            piece, states[groups[0]], states[groups[1]]);
+  }
+  fprintf(file, "};\n\n#endif // PIECES_H\n");
 
-  errno = 0;
-  const uint32_t bits = strtoul(str, &end, 10);
-  if (errno || end == str || *end != '\0') {
-    fprintf(stderr, "Usage: %s BITS\n", argv[0]);
+  return fclose(file) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// shuffles for the next four groups by their widths, one lookup resolves
+// all four. digits are aligned right in four bytes per group and indexed
+// from the start of the first group. empty bytes are 192 rather than 128 so
+// that they keep the high bit when an offset is added, or subtracted by the
+// AVX2 parser to rebase the upper lane
+static int write_groups(const char *path)
+{
+  FILE *file;
+  if (!(file = fopen(path, "w")))
     return EXIT_FAILURE;
+
+  fprintf(file, "/*\n * groups.h -- shuffles to convert four groups at once\n *\n");
+  fprintf(file, " * generated by perm, do not edit\n *\n */\n");
+  fprintf(file, "#ifndef GROUPS_H\n#define GROUPS_H\n\n#include <stdint.h>\n\n");
+  fprintf(file, "#define GROUP_WIDTHS (5)\n#define GROUP_KEYS (625)\n\n");
+  fprintf(file, "// shuffle by width0 + 5 * width1 + 25 * width2 + 125 * width3, widths are\n");
+  fprintf(file, "// 0 to 4 digits. a group that is not there is converted as an empty group\n");
+  fprintf(file, "static const uint8_t group_shuffles[GROUP_KEYS][16] __attribute__((aligned(16))) = {\n");
+  for (uint32_t key=0; key < 625; key++) {
+    const uint32_t widths[4] = { key % 5, key / 5 % 5, key / 25 % 5, key / 125 };
+    uint8_t shuffle[16];
+    uint32_t start = 0;
+    memset(shuffle, 192, sizeof(shuffle));
+    for (uint32_t group=0; group < 4; group++) {
+      for (uint32_t digit=4 - widths[group]; digit < 4; digit++)
+        shuffle[4 * group + digit] = (uint8_t)(start + digit - (4 - widths[group]));
+      start += widths[group] + 1;
+    }
+    fprintf(file, "  {");
+    for (uint32_t i=0; i < 16; i++)
+      fprintf(file, "%s%3u", i ? ", " : " ", shuffle[i]);
+    fprintf(file, " }%s // %3u: %u, %u, %u, %u\n", key < 624 ? "," : " ",
+            key, widths[0], widths[1], widths[2], widths[3]);
+  }
+  fprintf(file, "};\n\n#endif // GROUPS_H\n");
+
+  return fclose(file) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// layout of an address by the number of groups before and after :: and
+// whether it ends in a dotted quad, which takes the place of two groups. keys
+// match the layouts reported by bench
+typedef struct layout layout_t;
+struct layout {
+  uint32_t before, after;
+  bool compressed, quad;
+  char key[16];
+};
+
+#define LAYOUTS (64)
+
+static uint32_t enumerate_layouts(layout_t layouts[LAYOUTS])
+{
+  uint32_t count = 0;
+  for (uint32_t quad = 0; quad < 2; quad++) {
+    layouts[count++] = (layout_t){ 8 - 2 * quad, 0, false, quad, "" };
+    // :: covers one or more groups (RFC 4291)
+    for (uint32_t groups = 0; groups + 2 * quad <= 7; groups++)
+      for (uint32_t before = 0; before <= groups; before++)
+        layouts[count++] = (layout_t){ before, groups - before, true, quad, "" };
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    const char *quad = layouts[i].quad ? "+v4" : "";
+    if (layouts[i].compressed)
+      snprintf(layouts[i].key, sizeof(layouts[i].key), "%u::%u%s",
+        layouts[i].before, layouts[i].after, quad);
+    else
+      snprintf(layouts[i].key, sizeof(layouts[i].key), "%u%s",
+        layouts[i].before, quad);
+  }
+
+  assert(count <= LAYOUTS);
+  return count;
+}
+
+// expand a layout into an address. widths holds the number of digits of each
+// group (one to four), followed by that of each octet (one to three) if the
+// address ends in a dotted quad. digits and letter case are random
+static void expand(
+  corpus_record_t *record, const layout_t *layout, const uint8_t *widths)
+{
+  static const char digits[] = "0123456789abcdef";
+  static const uint32_t minimums[4] = { 0, 0, 10, 100 };
+  static const uint32_t maximums[4] = { 0, 9, 99, 255 };
+  const uint32_t groups = layout->before + layout->after;
+  size_t length = 0;
+  bool colon = false;
+
+  memset(record, 0, sizeof(*record));
+  for (uint32_t group = 0; group <= groups; group++) {
+    if (layout->compressed && group == layout->before) {
+      record->text[length++] = ':';
+      record->text[length++] = ':';
+      colon = false;
+    }
+    if (group == groups)
+      break;
+    if (colon)
+      record->text[length++] = ':';
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < widths[group]; i++) {
+      const uint32_t digit = (uint32_t)random() % 16;
+      value = (value << 4) | digit;
+      char character = digits[digit];
+      if (digit > 9 && (random() & 1))
+        character = (char)(character - 0x20);
+      record->text[length++] = character;
+    }
+    // groups that follow :: are at the end
+    const uint32_t index = group < layout->before
+      ? group : 8 - 2 * layout->quad - groups + group;
+    record->octets[2 * index] = (uint8_t)(value >> 8);
+    record->octets[2 * index + 1] = (uint8_t)value;
+    colon = true;
   }
 
+  if (layout->quad) {
+    if (colon)
+      record->text[length++] = ':';
+    for (uint32_t i = 0; i < 4; i++) {
+      const uint32_t width = widths[groups + i];
+      const uint32_t value = minimums[width] +
+        (uint32_t)random() % (maximums[width] - minimums[width] + 1);
+      length += (size_t)sprintf(record->text + length, "%s%u", i ? "." : "", value);
+      record->octets[12 + i] = (uint8_t)value;
+    }
+  }
+
+  assert(length < sizeof(record->text));
+}
+
+// advance to the next combination of widths, returns false after the last
+static bool next_widths(uint8_t *widths, const layout_t *layout)
+{
+  const uint32_t groups = layout->before + layout->after;
+  const uint32_t count = groups + 4 * layout->quad;
+  for (uint32_t i = 0; i < count; i++) {
+    if (widths[i] < (i < groups ? 4 : 3)) {
+      widths[i]++;
+      return true;
+    }
+    widths[i] = 1;
+  }
+  return false;
+}
+
+static void random_widths(uint8_t *widths, const layout_t *layout)
+{
+  const uint32_t groups = layout->before + layout->after;
+  for (uint32_t i = 0; i < groups; i++)
+    widths[i] = (uint8_t)(1 + random() % 4);
+  for (uint32_t i = groups; i < groups + 4 * layout->quad; i++)
+    widths[i] = (uint8_t)(1 + random() % 3);
+}
+
+// weights are given as a comma-separated list of layout=weight pairs, e.g.
+// 8=60,2::1=20,0::1=10,6+v4=10. layouts that are not listed are not sampled
+static bool parse_weights(
+  const char *str, const layout_t *layouts, uint32_t count, uint64_t *weights)
+{
+  char *copy, *save = NULL;
+  if (!(copy = strdup(str)))
+    return false;
+
+  memset(weights, 0, count * sizeof(*weights));
+  for (char *pair = strtok_r(copy, ",", &save); pair; pair = strtok_r(NULL, ",", &save)) {
+    char *weight = strchr(pair, '='), *end = NULL;
+    uint32_t layout = 0;
+    if (weight)
+      *weight++ = '\0';
+    for (; layout < count && strcmp(layouts[layout].key, pair) != 0; layout++)
+      ;
+    errno = 0;
+    if (layout < count && weight)
+      weights[layout] = strtoull(weight, &end, 10);
+    if (layout == count || !weight || errno || end == weight || *end) {
+      fprintf(stderr, "Invalid weight for layout %s, layouts are:", pair);
+      for (layout = 0; layout < count; layout++)
+        fprintf(stderr, " %s", layouts[layout].key);
+      fprintf(stderr, "\n");
+      free(copy);
+      return false;
+    }
+  }
+
+  free(copy);
+  return true;
+}
+
+// write a corpus of every layout with every combination of widths, or of
+// samples addresses drawn from the layouts by weight
+static int write_corpus(
+  const char *path, uint64_t samples, const char *weights, uint64_t seed)
+{
+  layout_t layouts[LAYOUTS];
+  uint64_t cumulative[LAYOUTS], total = 0;
+  const uint32_t layout_count = enumerate_layouts(layouts);
+
+  if (weights && !parse_weights(weights, layouts, layout_count, cumulative))
+    return EXIT_FAILURE;
+  for (uint32_t i = 0; i < layout_count; i++)
+    cumulative[i] = (total += weights ? cumulative[i] : 1);
+  if (samples && !total) {
+    fprintf(stderr, "Weights must not all be zero\n");
+    return EXIT_FAILURE;
+  }
+
+  FILE *file;
+  if (!(file = fopen(path, "wb"))) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  srandom((unsigned int)seed);
+
+  corpus_header_t header = { CORPUS_MAGIC, CORPUS_VERSION, sizeof(corpus_record_t), 0, seed, { 0 } };
+  fwrite(&header, sizeof(header), 1, file);
+
+  corpus_record_t record;
+  uint8_t widths[12];
+  if (samples) {
+    for (uint64_t i = 0; i < samples; i++) {
+      const uint64_t sample =
+        (((uint64_t)random() << 31) | (uint64_t)random()) % total;
+      uint32_t layout = 0;
+      for (; cumulative[layout] <= sample; layout++)
+        ;
+      random_widths(widths, &layouts[layout]);
+      expand(&record, &layouts[layout], widths);
+      fwrite(&record, sizeof(record), 1, file);
+    }
+    header.count = samples;
+  } else {
+    for (uint32_t layout = 0; layout < layout_count; layout++) {
+      memset(widths, 1, sizeof(widths));
+      do {
+        expand(&record, &layouts[layout], widths);
+        fwrite(&record, sizeof(record), 1, file);
+        header.count++;
+      } while (next_widths(widths, &layouts[layout]));
+    }
+  }
+
+  static const uint8_t padding[CORPUS_PADDING] = { 0 };
+  fwrite(padding, sizeof(padding), 1, file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+
+  if (ferror(file) | fclose(file)) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  printf("wrote %" PRIu64 " addresses to %s\n", header.count, path);
+  return EXIT_SUCCESS;
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s BITS | -o HEADER | -f HEADER | -g HEADER | -c CORPUS [-n COUNT] [-w WEIGHTS] [-s SEED]\n", program);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  BITS        print every layout of delimiters in BITS bytes\n");
+  fprintf(stderr, "  -o HEADER   write shuffles to expand compressed groups to HEADER\n");
+  fprintf(stderr, "  -f HEADER   write shuffles of the formatter to HEADER\n");
+  fprintf(stderr, "  -g HEADER   write shuffles to convert four groups by width to HEADER\n");
+  fprintf(stderr, "  -c CORPUS   write every layout with every combination of widths to CORPUS\n");
+  fprintf(stderr, "  -n COUNT    write COUNT addresses sampled from the layouts instead\n");
+  fprintf(stderr, "  -w WEIGHTS  sample layouts by weight, e.g. 8=60,2::1=20,0::1=10,6+v4=10\n");
+  fprintf(stderr, "  -s SEED     seed for digits, letter case and sampling (default: 1)\n");
+  exit(EXIT_FAILURE);
+}
+
+static uint64_t parse_number(const char *program, const char *str, const uint64_t minimum)
+{
+  char *end = NULL;
+  errno = 0;
+  const uint64_t number = strtoull(str, &end, 10);
+  if (errno || end == str || *end || number < minimum)
+    usage(program);
+  return number;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *program = argv[0];
+  const char *header = NULL, *pieces = NULL, *shuffles = NULL, *corpus = NULL, *weights = NULL;
+  uint64_t samples = 0, seed = 1;
+
+  int option;
+  while ((option = getopt(argc, argv, "o:f:g:c:n:w:s:")) != -1) {
+    switch (option) {
+      case 'o':
+        header = optarg;
+        break;
+      case 'f':
+        pieces = optarg;
+        break;
+      case 'g':
+        shuffles = optarg;
+        break;
+      case 'c':
+        corpus = optarg;
+        break;
+      case 'n':
+        samples = parse_number(program, optarg, 1);
+        break;
+      case 'w':
+        weights = optarg;
+        break;
+      case 's':
+        seed = parse_number(program, optarg, 0);
+        break;
+      default:
+        usage(program);
+    }
+  }
+
+  if (header)
+    return write_expansions(header);
+  if (pieces)
+    return write_pieces(pieces);
+  if (shuffles)
+    return write_groups(shuffles);
+  if (corpus)
+    return write_corpus(corpus, weights && !samples ? 1000000u : samples, weights, seed);
+  if (argc - optind != 1)
+    usage(program);
+
+  const uint32_t bits = (uint32_t)parse_number(program, argv[optind], 0);
   const uint32_t groups = bits / 4; // maximum number of full hextets
 
   if (bits) {
@@ -0,0 +1,113 @@
+/*
+ * scalar.c -- scalar reference parser for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <string.h>
+#include <stdint.h>
+
+#include "ip6.h"
+
+static inline int32_t hex(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+// convert the dotted quad at src, octets are one to three digits without
+// leading zeros. returns the length, or 0 if the quad is invalid
+static size_t parse_quad(const char *src, uint8_t octets[4])
+{
+  size_t length = 0;
+  for (size_t octet = 0; octet < 4; octet++) {
+    if (octet && src[length++] != '.')
+      return 0;
+    uint32_t value = 0, digits = 0;
+    for (; src[length] >= '0' && src[length] <= '9'; length++, digits++)
+      value = value * 10 + (uint32_t)(src[length] - '0');
+    if (!digits || digits > 3 || value > 255 || (digits > 1 && src[length - digits] == '0'))
+      return 0;
+    octets[octet] = (uint8_t)value;
+  }
+  return length;
+}
+
+// same semantics as the vectorized parsers, :: takes the place of one or
+// more groups (RFC 4291)
+size_t parse_ip6_scalar(const char *src, void *dst)
+{
+  uint8_t address[16] = { 0 };
+  size_t length = 0, groups = 0, compressed = SIZE_MAX;
+
+  if (src[0] == ':') {
+    if (src[1] != ':')
+      return 0;
+    compressed = 0;
+    length = 2;
+  }
+
+  while (hex(src[length]) >= 0) {
+    const size_t start = length;
+    uint32_t value = 0;
+    for (; hex(src[length]) >= 0 && length - start < 5; length++)
+      value = (value << 4) | (uint32_t)hex(src[length]);
+    if (length - start > 4)
+      return 0;
+
+    // embedded IPv4 address, the group is actually the first octet
+    if (src[length] == '.') {
+      size_t quad;
+      if (!start || groups > 6 || !(quad = parse_quad(src + start, address + 2 * groups)))
+        return 0;
+      groups += 2;
+      length = start + quad;
+      if (hex(src[length]) >= 0)
+        return 0;
+      break;
+    }
+
+    if (groups == 8)
+      return 0;
+    address[2 * groups] = (uint8_t)(value >> 8);
+    address[2 * groups + 1] = (uint8_t)value;
+    groups++;
+
+    if (src[length] != ':')
+      break;
+    if (src[length + 1] == ':') {
+      if (compressed != SIZE_MAX)
+        return 0;
+      compressed = groups;
+      length += 2;
+    } else if (hex(src[length + 1]) >= 0) {
+      length += 1;
+    } else {
+      return 0;
+    }
+  }
+
+  if (src[length] == ':' || src[length] == '.')
+    return 0;
+
+  if (compressed == SIZE_MAX) {
+    if (groups != 8)
+      return 0;
+  } else {
+    if (groups > 7)
+      return 0;
+    // move groups that follow :: to the end
+    const size_t trailing = 2 * (groups - compressed);
+    memmove(address + 16 - trailing, address + 2 * compressed, trailing);
+    memset(address + 2 * compressed, 0, 16 - 2 * groups);
+  }
+
+  memcpy(dst, address, 16);
+  return length;
+}
@@ -0,0 +1,262 @@
+/*
+ * scan.c -- find IPv6 addresses in free text
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <immintrin.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ip6.h"
+#include "bits.h"
+
+// every address contains at least two colons. text is searched for colons
+// 64 bytes at a time, which is all there is to it for text without any. a
+// colon that is not part of an earlier run is a candidate, the run of hex
+// digits, colons and dots around it is found from the classes of the block
+// and parsed if it starts and ends on a word boundary. runs that are not an
+// address, e.g. times and MAC addresses, are skipped as a whole
+
+#define HEX (1u)
+#define COLON (2u)
+#define DOT (4u)
+#define WORD (8u) // letters, digits and underscore
+
+static const uint8_t classes[256] = {
+  ['0'] = HEX|WORD, ['1'] = HEX|WORD, ['2'] = HEX|WORD, ['3'] = HEX|WORD,
+  ['4'] = HEX|WORD, ['5'] = HEX|WORD, ['6'] = HEX|WORD, ['7'] = HEX|WORD,
+  ['8'] = HEX|WORD, ['9'] = HEX|WORD,
+  ['a'] = HEX|WORD, ['b'] = HEX|WORD, ['c'] = HEX|WORD, ['d'] = HEX|WORD,
+  ['e'] = HEX|WORD, ['f'] = HEX|WORD,
+  ['A'] = HEX|WORD, ['B'] = HEX|WORD, ['C'] = HEX|WORD, ['D'] = HEX|WORD,
+  ['E'] = HEX|WORD, ['F'] = HEX|WORD,
+  ['g'] = WORD, ['h'] = WORD, ['i'] = WORD, ['j'] = WORD, ['k'] = WORD,
+  ['l'] = WORD, ['m'] = WORD, ['n'] = WORD, ['o'] = WORD, ['p'] = WORD,
+  ['q'] = WORD, ['r'] = WORD, ['s'] = WORD, ['t'] = WORD, ['u'] = WORD,
+  ['v'] = WORD, ['w'] = WORD, ['x'] = WORD, ['y'] = WORD, ['z'] = WORD,
+  ['G'] = WORD, ['H'] = WORD, ['I'] = WORD, ['J'] = WORD, ['K'] = WORD,
+  ['L'] = WORD, ['M'] = WORD, ['N'] = WORD, ['O'] = WORD, ['P'] = WORD,
+  ['Q'] = WORD, ['R'] = WORD, ['S'] = WORD, ['T'] = WORD, ['U'] = WORD,
+  ['V'] = WORD, ['W'] = WORD, ['X'] = WORD, ['Y'] = WORD, ['Z'] = WORD,
+  ['_'] = WORD, [':'] = COLON, ['.'] = DOT
+};
+
+#define class_of(c) (classes[(uint8_t)(c)])
+
+__attribute__((always_inline))
+static inline uint64_t find_colons(const char *src)
+{
+  const __m128i colon = _mm_set1_epi8(':');
+  uint64_t colons = 0;
+  for (uint32_t i = 0; i < 4; i++)
+    colons |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+      _mm_loadu_si128((const __m128i *)(src + 16 * i)), colon)) << (16 * i);
+  return colons;
+}
+
+// hex digits in 16 bytes at src, colons and dots are added to the mask the
+// function returns
+__attribute__((always_inline))
+static inline uint32_t classify_run(const char *src, uint32_t *hex)
+{
+  const __m128i text = _mm_loadu_si128((const __m128i *)src);
+  // colons follow the digits, letters are checked in lower case
+  const __m128i digits = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+  const __m128i letters = _mm_sub_epi8(
+    _mm_or_si128(text, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  const __m128i is_digit =
+    _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+  const __m128i is_letter =
+    _mm_cmpeq_epi8(_mm_min_epu8(letters, _mm_set1_epi8(5)), letters);
+  const __m128i is_colon = _mm_cmpeq_epi8(digits, _mm_set1_epi8(':' - '0'));
+  const __m128i is_dot = _mm_cmpeq_epi8(text, _mm_set1_epi8('.'));
+  const __m128i is_hex = _mm_or_si128(is_digit, is_letter);
+  *hex = (uint16_t)_mm_movemask_epi8(is_hex);
+  return (uint16_t)_mm_movemask_epi8(
+    _mm_or_si128(is_hex, _mm_or_si128(is_colon, is_dot)));
+}
+
+// letters past f and underscores in 16 bytes at src, i.e. word characters
+// that cannot be part of a run
+__attribute__((always_inline))
+static inline uint32_t classify_letters(const char *src)
+{
+  const __m128i text = _mm_loadu_si128((const __m128i *)src);
+  const __m128i letters = _mm_sub_epi8(
+    _mm_or_si128(text, _mm_set1_epi8(0x20)), _mm_set1_epi8('g'));
+  const __m128i is_letter =
+    _mm_cmpeq_epi8(_mm_min_epu8(letters, _mm_set1_epi8(19)), letters);
+  const __m128i is_underscore = _mm_cmpeq_epi8(text, _mm_set1_epi8('_'));
+  return (uint16_t)_mm_movemask_epi8(_mm_or_si128(is_letter, is_underscore));
+}
+
+typedef struct block block_t;
+struct block { uint64_t colons, hex, runs, letters; };
+
+// hex digits, bytes that may be part of a run and other word characters in
+// 64 bytes at src
+__attribute__((always_inline))
+static inline void classify_block(const char *src, block_t *block)
+{
+  uint64_t hex = 0, runs = 0, letters = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    uint32_t digits;
+    runs |= (uint64_t)classify_run(src + 16 * i, &digits) << (16 * i);
+    hex |= (uint64_t)digits << (16 * i);
+    letters |= (uint64_t)classify_letters(src + 16 * i) << (16 * i);
+  }
+  block->hex = hex;
+  block->runs = runs;
+  block->letters = letters;
+}
+
+// tell if the run from start to end in the block at base may be an address,
+// i.e. it has at most four hex digits between delimiters, at most one "::",
+// seven colons or six and an IPv4 address if it has none and three dots after
+// the last colon if it has an IPv4 address. times, MAC addresses and the like
+// are ruled out by the masks alone
+__attribute__((always_inline))
+static inline bool plausible(const block_t *block, size_t start, size_t end)
+{
+  const uint64_t run = ((1llu << end) - 1) & (~0llu << start);
+  const uint64_t hex = block->hex & run, colons = block->colons & run;
+  const uint64_t dots = block->runs & ~block->hex & ~block->colons & run;
+  const uint64_t pairs = colons & (colons >> 1);
+  const uint32_t count = (uint32_t)count_ones(colons);
+
+  if (hex & (hex >> 1) & (hex >> 2) & (hex >> 3) & (hex >> 4))
+    return false;
+  if (pairs & (pairs - 1))
+    return false;
+  if (dots && (count_ones(dots) != 3 || first_trailing_one(dots) < colons))
+    return false;
+  if (!pairs)
+    return count == 7u - (dots != 0);
+  return count <= 8u - (dots != 0);
+}
+
+// parse the run around the colon at offset, returns the end of the run. the
+// run is taken from the masks of the block at base, runs that cross the
+// block are extended 16 bytes at a time and bytes before floor or past len
+// are never read
+__attribute__((noinline))
+static size_t scan_run(
+  const char *src, size_t len, size_t base, const block_t *block,
+  size_t offset, size_t floor, ip6_match_t *match)
+{
+  size_t start, end;
+  const uint64_t below = ~block->hex & ((1llu << (offset - base)) - 1);
+  if (likely(below)) {
+    start = base + 64 - leading_zeros(below);
+  } else {
+    uint32_t hex;
+    for (start = base; start >= floor + 16; start -= 16) {
+      classify_run(src + start - 16, &hex);
+      if (~hex & 0xffffu) {
+        start -= leading_zeros((uint64_t)(~hex & 0xffffu) << 48);
+        break;
+      }
+    }
+    while (start > floor && (class_of(src[start - 1]) & HEX))
+      start--;
+  }
+  if (start < floor)
+    start = floor;
+
+  const uint64_t above = ~block->runs >> (offset - base);
+  if (likely(above)) {
+    end = offset + trailing_zeros(above);
+  } else {
+    uint32_t hex, others;
+    for (end = base + 64; end + 16 <= len; end += 16) {
+      if ((others = ~classify_run(src + end, &hex) & 0xffffu)) {
+        end += trailing_zeros(others);
+        break;
+      }
+    }
+    while (end < len && (class_of(src[end]) & (HEX|COLON|DOT)))
+      end++;
+  }
+
+  match->length = 0;
+  // letters, digits, underscores and dots directly before or after a run
+  // make it part of a word, e.g. a qualified name or a version number
+  if ((start && (class_of(src[start - 1]) & (WORD|DOT))) ||
+      (end < len && (class_of(src[end]) & WORD)))
+    return end;
+  // a run with a single colon, e.g. a port number, is not an address
+  const uint64_t colons = block->colons >> (offset - base) >> 1;
+  if (end - base < 64 && !(colons & ((1llu << (end - offset - 1)) - 1)))
+    return end;
+  // runs within the block are checked against the masks before parsing
+  if (end - base < 64 && start >= base &&
+      !plausible(block, start - base, end - base - (src[end - 1] == '.')))
+    return end;
+
+  uint8_t address[32];
+  size_t length;
+  // a dot that ends a sentence is not part of the address. the parser would
+  // take it for an IPv4 address and fail, the run is parsed from a copy
+  // without the dot instead
+  if (src[end - 1] == '.' && end - start <= 64) {
+    char text[64 + IP6_PADDING] = { 0 };
+    memcpy(text, src + start, end - start - 1);
+    length = parse_ip6_sse41(text, address);
+  } else {
+    length = parse_ip6_bounded_sse41(
+      src + start, end - start - (src[end - 1] == '.'), address);
+  }
+  if (length && length >= end - start - 1) {
+    match->offset = start;
+    match->length = length;
+    memcpy(match->address, address, 16);
+  }
+  return end;
+}
+
+size_t scan_ip6(const char *src, size_t len, ip6_match_t *matches, size_t count)
+{
+  size_t found = 0, resume = 0;
+
+  for (size_t base = 0; base < len && found < count; base += 64) {
+    const char *text = src + base;
+    char tail[64];
+    if (unlikely(len - base < 64)) {
+      memset(tail, 0, sizeof(tail));
+      text = memcpy(tail, src + base, len - base);
+    }
+    uint64_t colons = find_colons(text);
+    block_t block = { colons, 0, 0, 0 };
+
+    // skip colons that are part of a run that was scanned already
+    if (resume > base)
+      colons &= resume - base >= 64 ? 0 : ~0llu << (resume - base);
+    if (likely(!colons))
+      continue;
+    // bytes past len are zero and end a run
+    classify_block(text, &block);
+    // a run that follows a letter is part of a word. adding its first byte
+    // to the mask of runs clears the run, so its colons are dropped without
+    // scanning it. a run that continues into the next block is scanned to
+    // find its end
+    const uint64_t after = (block.letters << 1) |
+      (base && (class_of(src[base - 1]) & (HEX|WORD)) == WORD);
+    uint64_t words = block.runs & ~(block.runs + (after & block.runs));
+    if (words >> 63)
+      words &= (~0llu >> 1) >> (leading_zeros(~words) - 1);
+    colons &= ~words;
+    while (colons && found < count) {
+      const size_t offset = base + trailing_zeros(colons);
+      resume = scan_run(
+        src, len, base, &block, offset, resume, &matches[found]);
+      found += matches[found].length != 0;
+      colons &= resume - base >= 64 ? 0 : ~0llu << (resume - base);
+    }
+  }
+
+  return found;
+}
@@ -0,0 +1,488 @@
+/*
+ * sse41.h -- inlinable SSE 4.1 parser for IPv6 addresses
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef SSE41_H
+#define SSE41_H
+
+#include <assert.h>
+#include <immintrin.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "bits.h"
+#include "patterns.h"
+#include "groups.h"
+#include "expansions.h"
+#include "ip4.h"
+#include "stats.h"
+
+// shared by ip6.c and callers that define IP6_HEADER_ONLY, which must be
+// compiled with SSE 4.1, POPCNT, BMI1 and LZCNT enabled
+
+// lookups of the shuffle for the next two pairs of groups. split looks up
+// the id of the pattern, then the pattern, the second pair is hashed once the
+// shift of the first pair is loaded. fused looks up the pattern in its slot,
+// one load per pair. paired also derives the shift of the first pair from the
+// mask, both pairs are hashed from the same mask and loaded in parallel.
+// widths takes a single lookup for all four groups, keyed on their widths
+// rather than a hash of the mask
+#define IP6_PATTERNS_SPLIT (0)
+#define IP6_PATTERNS_FUSED (1)
+#define IP6_PATTERNS_PAIRED (2)
+#define IP6_PATTERNS_WIDTHS (3)
+
+#if !defined(IP6_PATTERNS)
+#define IP6_PATTERNS IP6_PATTERNS_WIDTHS
+#endif
+
+__attribute__((warn_unused_result)) __attribute__((always_inline))
+static inline uint32_t ip6_load_shuffle_mask_split(
+  __m128i *shuffle, uint32_t *bytes, uint32_t mask)
+{
+  uint32_t mask0 = clear_lowest_bit(clear_lowest_bit(mask));
+  mask0 ^= mask;
+  mask0 &= (1u << PATTERN_BITS) - 1u;
+  const uint32_t hash0 = ((mask0 * PATTERN_KEY) >> PATTERN_SHIFT) & PATTERN_MASK;
+  const uint8_t key0 = pattern_ids[hash0];
+  IP6_COUNT_PATTERN(key0, patterns[key0].mask == mask0);
+
+  __m128i shuffle0 = _mm_loadl_epi64((const __m128i*)patterns[key0].shuffle);
+  const uint8_t shift0 = patterns[key0].shift;
+
+  mask >>= shift0;
+
+  uint32_t mask1 = clear_lowest_bit(clear_lowest_bit(mask));
+  mask1 ^= mask;
+  mask1 &= (1u << PATTERN_BITS) - 1u;
+  const uint32_t hash1 = ((mask1 * PATTERN_KEY) >> PATTERN_SHIFT) & PATTERN_MASK;
+  const uint8_t key1 = pattern_ids[hash1];
+  IP6_COUNT_PATTERN(key1, patterns[key1].mask == mask1);
+
+  __m128i shuffle1 = _mm_loadl_epi64((const __m128i*)patterns[key1].shuffle);
+          shuffle1 = _mm_add_epi8(shuffle1, _mm_set1_epi8(shift0));
+
+  *shuffle = _mm_unpacklo_epi64(shuffle0, shuffle1);
+  *bytes += patterns[key0].bytes + patterns[key1].bytes;
+
+  return (patterns[key0].shift + patterns[key1].shift) &
+    (((mask0 != patterns[key0].mask) | (mask1 != patterns[key1].mask)) - 1u);
+}
+
+__attribute__((warn_unused_result)) __attribute__((always_inline))
+static inline uint32_t ip6_load_shuffle_mask_fused(
+  __m128i *shuffle, uint32_t *bytes, uint32_t mask)
+{
+  uint32_t mask0 = clear_lowest_bit(clear_lowest_bit(mask));
+  mask0 ^= mask;
+  mask0 &= (1u << PATTERN_BITS) - 1u;
+  const uint32_t hash0 = ((mask0 * PATTERN_KEY) >> PATTERN_SHIFT) & PATTERN_MASK;
+  IP6_COUNT_PATTERN(pattern_ids[hash0], pattern_slots[hash0].mask == mask0);
+
+  __m128i shuffle0 = _mm_loadl_epi64((const __m128i*)pattern_slots[hash0].shuffle);
+  const uint8_t shift0 = (uint8_t)pattern_slots[hash0].shift;
+
+  mask >>= shift0;
+
+  uint32_t mask1 = clear_lowest_bit(clear_lowest_bit(mask));
+  mask1 ^= mask;
+  mask1 &= (1u << PATTERN_BITS) - 1u;
+  const uint32_t hash1 = ((mask1 * PATTERN_KEY) >> PATTERN_SHIFT) & PATTERN_MASK;
+  IP6_COUNT_PATTERN(pattern_ids[hash1], pattern_slots[hash1].mask == mask1);
+
+  __m128i shuffle1 = _mm_loadl_epi64((const __m128i*)pattern_slots[hash1].shuffle);
+          shuffle1 = _mm_add_epi8(shuffle1, _mm_set1_epi8(shift0));
+
+  *shuffle = _mm_unpacklo_epi64(shuffle0, shuffle1);
+  *bytes += pattern_slots[hash0].bytes + pattern_slots[hash1].bytes;
+
+  return (shift0 + pattern_slots[hash1].shift) &
+    (((mask0 != pattern_slots[hash0].mask) | (mask1 != pattern_slots[hash1].mask)) - 1u);
+}
+
+__attribute__((warn_unused_result)) __attribute__((always_inline))
+static inline uint32_t ip6_load_shuffle_mask_paired(
+  __m128i *shuffle, uint32_t *bytes, uint32_t mask)
+{
+  uint32_t mask0 = clear_lowest_bit(clear_lowest_bit(mask));
+  mask0 ^= mask;
+  mask0 &= (1u << PATTERN_BITS) - 1u;
+  const uint32_t hash0 = ((mask0 * PATTERN_KEY) >> PATTERN_SHIFT) & PATTERN_MASK;
+  IP6_COUNT_PATTERN(pattern_ids[hash0], pattern_slots[hash0].mask == mask0);
+
+  // shift is the position of the second delimiter and follows directly from
+  // the mask, the second lookup therefore does not depend on the first
+  const uint32_t shift0 = (uint32_t)(64u - leading_zeros(mask0));
+
+  mask >>= shift0;
+
+  uint32_t mask1 = clear_lowest_bit(clear_lowest_bit(mask));
+  mask1 ^= mask;
+  mask1 &= (1u << PATTERN_BITS) - 1u;
+  const uint32_t hash1 = ((mask1 * PATTERN_KEY) >> PATTERN_SHIFT) & PATTERN_MASK;
+  IP6_COUNT_PATTERN(pattern_ids[hash1], pattern_slots[hash1].mask == mask1);
+
+  __m128i shuffle0 = _mm_loadl_epi64((const __m128i*)pattern_slots[hash0].shuffle);
+  __m128i shuffle1 = _mm_loadl_epi64((const __m128i*)pattern_slots[hash1].shuffle);
+          shuffle1 = _mm_add_epi8(shuffle1, _mm_set1_epi8((int8_t)shift0));
+
+  *shuffle = _mm_unpacklo_epi64(shuffle0, shuffle1);
+  *bytes += pattern_slots[hash0].bytes + pattern_slots[hash1].bytes;
+
+  return (shift0 + pattern_slots[hash1].shift) &
+    (((mask0 != pattern_slots[hash0].mask) | (mask1 != pattern_slots[hash1].mask)) - 1u);
+}
+
+// the widths of the groups follow from the positions of the first four
+// delimiters. delimiters are appended to the last in the mask, groups that
+// are not there are empty and do not count towards the shift or bytes
+__attribute__((warn_unused_result)) __attribute__((always_inline))
+static inline uint32_t ip6_load_shuffle_mask_widths(
+  __m128i *shuffle, uint32_t *bytes, uint32_t mask)
+{
+  const uint32_t end = (uint32_t)(64u - leading_zeros(mask));
+  const uint64_t delimiters = mask | (~0llu << end);
+  const uint64_t rest1 = clear_lowest_bit(delimiters);
+  const uint64_t rest2 = clear_lowest_bit(rest1);
+  const uint64_t rest3 = clear_lowest_bit(rest2);
+  const uint32_t position0 = (uint32_t)trailing_zeros(delimiters);
+  const uint32_t position1 = (uint32_t)trailing_zeros(rest1);
+  const uint32_t position2 = (uint32_t)trailing_zeros(rest2);
+  const uint32_t position3 = (uint32_t)trailing_zeros(rest3);
+
+  const uint32_t width0 = position0;
+  const uint32_t width1 = position1 - position0 - 1u;
+  const uint32_t width2 = position2 - position1 - 1u;
+  const uint32_t width3 = position3 - position2 - 1u;
+  const uint32_t valid =
+    (width0 < 5u) & (width1 < 5u) & (width2 < 5u) & (width3 < 5u);
+  const uint32_t key =
+    (width0 + 5u * width1 + 25u * width2 + 125u * width3) & (0u - valid);
+  IP6_COUNT_GROUPS(key, valid);
+
+  *shuffle = _mm_load_si128((const __m128i *)group_shuffles[key]);
+  const uint32_t groups = (uint32_t)count_ones(mask);
+  *bytes += 2u * (groups < 4u ? groups : 4u);
+
+  const uint32_t shift = position3 < end ? position3 + 1u : end;
+  return shift & (0u - valid);
+}
+
+__attribute__((warn_unused_result)) __attribute__((always_inline))
+static inline uint32_t ip6_load_shuffle_mask(
+  __m128i *shuffle, uint32_t *bytes, uint32_t mask)
+{
+#if IP6_PATTERNS == IP6_PATTERNS_SPLIT
+  return ip6_load_shuffle_mask_split(shuffle, bytes, mask);
+#elif IP6_PATTERNS == IP6_PATTERNS_FUSED
+  return ip6_load_shuffle_mask_fused(shuffle, bytes, mask);
+#elif IP6_PATTERNS == IP6_PATTERNS_WIDTHS
+  return ip6_load_shuffle_mask_widths(shuffle, bytes, mask);
+#else
+  return ip6_load_shuffle_mask_paired(shuffle, bytes, mask);
+#endif
+}
+
+// classified 16-byte input window, carried between iterations and records
+struct ip6_window {
+  const char *base;
+  __m128i text;
+  __m128i digits;
+  uint64_t colons;
+  uint64_t non_digits;
+};
+
+__attribute__((always_inline))
+static inline void ip6_classify(struct ip6_window *window, const char *src)
+{
+  const __m128i delta_check = _mm_setr_epi8(
+    -16, -32, -47, 71, 58, -96, 26, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i delta_rebase = _mm_setr_epi8(
+    0, 0, -47, -47, -54, 0, -86, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  __m128i input = _mm_loadu_si128((const __m128i*)src);
+  window->base = src;
+  window->text = input;
+  window->colons = (uint16_t)_mm_movemask_epi8(
+    _mm_cmpeq_epi8(input, _mm_set1_epi8(':')));
+
+  // TODO: Describe the reasoning behind -1 (credit @aqrit).
+  input = _mm_add_epi8(input, _mm_set1_epi8(-1));
+  __m128i keys = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0f));
+
+  window->non_digits = (uint16_t)_mm_movemask_epi8(
+    _mm_add_epi8(_mm_shuffle_epi8(delta_check, keys), input));
+  window->digits = _mm_add_epi8(input, _mm_shuffle_epi8(delta_rebase, keys));
+}
+
+// full-form addresses, eight groups of four digits, have colons at fixed
+// positions. the groups are converted with a fixed shuffle from windows at
+// offsets 0, 15 and 30, each starting with a group. every window is checked
+// before the next is loaded, the last is read only if the input extends to
+// it. the window is left at the last window on success, untouched otherwise
+__attribute__((always_inline))
+static inline size_t ip6_parse_full(
+  const char *src, void *dst, struct ip6_window *window)
+{
+  struct ip6_window windows[3];
+  ip6_classify(&windows[0], src);
+  if ((windows[0].colons ^ 0x4210u) | (windows[0].non_digits ^ 0x4210u))
+    return 0u;
+  ip6_classify(&windows[1], src + 15);
+  if ((windows[1].colons ^ 0x4210u) | (windows[1].non_digits ^ 0x4210u))
+    return 0u;
+  // the delimiter is not a colon or a dot
+  ip6_classify(&windows[2], src + 30);
+  if ((((windows[2].colons ^ 0x010u) | (windows[2].non_digits ^ 0x210u)) & 0x3ffu) ||
+      src[39] == '.')
+    return 0u;
+
+  const __m128i groups = _mm_setr_epi8(
+    0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -128, -128, -128, -128);
+  const __m128i weights = _mm_set1_epi16(0x0110);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i input[3];
+  for (uint32_t i = 0; i < 3; i++)
+    input[i] = _mm_packus_epi16(_mm_maddubs_epi16(
+      _mm_shuffle_epi8(windows[i].digits, groups), weights), zero);
+  // the third group of the last window is past the delimiter, shift it out
+  input[2] = _mm_slli_si128(input[2], 12);
+  _mm_storeu_si128((__m128i *)dst, _mm_or_si128(
+    _mm_or_si128(input[0], _mm_slli_si128(input[1], 6)), input[2]));
+
+  *window = windows[2];
+  return 39u;
+}
+
+// parse address at src, which must be at most 11 bytes into the already
+// classified window so that the first group and its delimiter are visible.
+// the window is left at the last 16 bytes loaded, which includes the
+// delimiter unless the address ends in a dotted quad
+__attribute__((always_inline))
+static inline size_t ip6_parse(
+  const char *src, void *dst, struct ip6_window *window)
+{
+  const uint64_t offset = (uint64_t)(src - window->base);
+  assert(offset <= 11);
+
+  uint64_t colons = window->colons >> offset;
+  uint64_t non_digits = window->non_digits >> offset;
+
+  // Leading :: requires sepcial handling.
+  // :: is allowed, as is abcd:, but not :abcd.
+  if (unlikely((colons & 3llu) == 1llu))
+    return IP6_REJECT(LEADING_COLON);
+
+  // leading :: is parsed from the second colon, which leaves one empty group
+  // before it as for :: elsewhere. otherwise :: in place of a single group
+  // at the start would take nine groups
+  const uint32_t leading = (colons & 3llu) == 3llu;
+  src += leading;
+  colons >>= leading;
+  non_digits >>= leading;
+
+  // three groups of four digits likely start a full-form address
+  if (!(((colons ^ 0x210u) | (non_digits ^ 0x210u)) & 0x3fffu)) {
+    const size_t size = ip6_parse_full(src, dst, window);
+    if (likely(size)) {
+      IP6_COUNT(parsed);
+      IP6_COUNT(full);
+      return size;
+    }
+  }
+
+  uint64_t mask;
+  uint64_t delimiter = first_trailing_one(non_digits ^ colons);
+  colons &= (delimiter - 1llu);
+  mask = colons;
+  colons |= delimiter;
+
+  __m128i input, shuffle;
+  uint32_t size, shift, bytes = 0, loads = 0;
+  if (!(shift = ip6_load_shuffle_mask(&shuffle, &bytes, colons)))
+    return IP6_REJECT(PATTERN);
+
+  shuffle = _mm_add_epi8(shuffle, _mm_set1_epi8((int8_t)(offset + leading)));
+  input = _mm_shuffle_epi8(window->digits, shuffle);
+  input = _mm_maddubs_epi16(input, _mm_set1_epi16(0x0110));
+  input = _mm_packus_epi16(input, input);
+  _mm_storeu_si128((__m128i *)dst, input);
+
+  size = shift;
+  colons >>= shift;
+
+  while (bytes < 16 && !(delimiter && !colons)) {
+    ip6_classify(window, src + size);
+    colons = window->colons;
+    non_digits = window->non_digits;
+
+    delimiter = first_trailing_one(non_digits ^ colons);
+    colons &= delimiter - 1;
+    mask |= (colons << size);
+    colons |= delimiter;
+
+    uint8_t *out = (uint8_t*)dst + bytes;
+    loads++;
+    if (!(shift = ip6_load_shuffle_mask(&shuffle, &bytes, colons)))
+      return IP6_REJECT(PATTERN);
+    size += shift;
+    colons >>= shift;
+
+    input = _mm_shuffle_epi8(window->digits, shuffle);
+    input = _mm_maddubs_epi16(input, _mm_set1_epi16(0x0110));
+    input = _mm_packus_epi16(input, input);
+    _mm_storeu_si128((__m128i *)out, input);
+  }
+
+  IP6_COUNT_ITERATIONS(loads);
+  size -= 1u; // Account for delimiter.
+
+  // :: in place of the last group, the loop may stop at eight groups before
+  // the empty group that follows, which must not be followed by digits
+  if (unlikely(src[size] == ':' && src[size - 1] == ':')) {
+    const uint8_t next = (uint8_t)src[size + 1];
+    if ((uint8_t)(next - '0') < 10u || (uint8_t)((next | 0x20) - 'a') < 6u)
+      return IP6_REJECT(COMPRESSED);
+    mask |= 1llu << size;
+    bytes += 2u;
+    size++;
+  }
+
+  src -= leading;
+  mask = (mask << leading) | leading;
+  size += leading;
+  assert(size <= INET6_ADDRSTRLEN);
+
+  // embedded IPv4 address, the last group is actually the first octet
+  if (unlikely(src[size] == '.')) {
+    if (!mask)
+      return IP6_REJECT(EMBEDDED);
+    uint32_t octets, length;
+    const uint32_t start = (uint32_t)(64u - leading_zeros(mask));
+    // convert from the last window if the quad is contained within it
+    const uint32_t offset = (uint32_t)(src + start - window->base);
+    if (!(length = parse_dotted_quad(window->text, offset, &octets)) &&
+        (!offset || !(length = parse_dotted_quad(
+          _mm_loadu_si128((const __m128i *)(src + start)), 0, &octets))))
+      return IP6_REJECT(EMBEDDED);
+    bytes -= 2u;
+    memcpy((uint8_t *)dst + bytes, &octets, sizeof(octets));
+    bytes += 4u;
+    size = start + length;
+    // a hex digit directly following the quad is not a delimiter
+    if (unlikely((uint8_t)((src[size] | 0x20) - 'a') < 6u))
+      return IP6_REJECT(EMBEDDED);
+  }
+
+  if (unlikely(src[size] == ':' || src[size] == '.'))
+    return IP6_REJECT(DELIMITER);
+
+  // a trailing empty group must be part of ::, abcd:: is allowed, abcd: is not
+  const uint64_t last = (1llu << size) >> 1;
+  if (unlikely((mask & last) && !(mask & (last >> 1))))
+    return IP6_REJECT(TRAILING_COLON);
+
+  uint64_t compressed = (mask << 1) & mask;
+  if (compressed) {
+    // :: takes the place of one or more groups (RFC 4291), the empty group
+    // is included in bytes. trailing :: includes an additional empty group
+    bytes -= 2u * ((mask & last) != 0);
+    if ((count_ones(compressed) > 1) || (bytes > 16))
+      return IP6_REJECT(COMPRESSED);
+    // move groups that follow :: to the end, zero the groups in between
+    const uint64_t group = count_ones(mask & (compressed - 1)) - leading;
+    const __m128i expansion =
+      _mm_load_si128((const __m128i *)expansions[group][bytes >> 1]);
+    __m128i address = _mm_loadu_si128((const __m128i *)dst);
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(address, expansion));
+    bytes = 16;
+  }
+
+  if (bytes != 16)
+    return IP6_REJECT(GROUPS);
+
+  IP6_COUNT(parsed);
+  return size;
+}
+
+// parse the prefix length that follows the address. the digits are
+// converted from the window that holds the delimiter if they are within it
+__attribute__((always_inline))
+static inline size_t ip6_parse_prefix(
+  const char *src, size_t size, uint8_t *prefix, struct ip6_window *window)
+{
+  static const uint32_t minimums[4] = { 0, 0, 10, 100 };
+  const char *slash = src + size;
+  if (*slash != '/')
+    return 0u;
+
+  // one to three digits and the delimiter must fit in the window
+  uint64_t offset = (uint64_t)(slash - window->base);
+  if (offset > 11) {
+    ip6_classify(window, slash);
+    offset = 0;
+  }
+
+  const uint64_t decimals = ~window->non_digits & (uint16_t)_mm_movemask_epi8(
+    _mm_cmplt_epi8(window->digits, _mm_set1_epi8(10)));
+  const uint64_t digits = trailing_zeros(
+    first_trailing_one(~decimals >> (offset + 1)));
+  if (digits - 1u > 2u)
+    return 0u;
+
+  // right-align the digits, positions before the first digit are zeroed
+  const uint64_t start = offset + 1;
+  __m128i shuffle = _mm_add_epi8(
+    _mm_setr_epi8(-3, -2, -1, -128, -128, -128, -128, -128,
+                  -128, -128, -128, -128, -128, -128, -128, -128),
+    _mm_set1_epi8((int8_t)(start + digits)));
+  shuffle = _mm_or_si128(
+    shuffle, _mm_cmpgt_epi8(_mm_set1_epi8((int8_t)start), shuffle));
+  const __m128i value = _mm_madd_epi16(
+    _mm_maddubs_epi16(_mm_shuffle_epi8(window->digits, shuffle),
+      _mm_setr_epi8(100, 10, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)),
+    _mm_set1_epi16(1));
+  const uint32_t length = (uint32_t)_mm_cvtsi128_si32(value);
+
+  // leading zeros are not allowed
+  if (length > 128 || length < minimums[digits])
+    return 0u;
+
+  // a hex digit, colon, dot or slash directly following the prefix length
+  // is not a delimiter
+  const char next = slash[1 + digits];
+  if (unlikely(!((window->non_digits >> (start + digits)) & 1u) ||
+               next == ':' || next == '.' || next == '/'))
+    return 0u;
+
+  *prefix = (uint8_t)length;
+  return size + 1 + digits;
+}
+
+// inlinable equivalents of parse_ip6_sse41 and parse_ip6_prefix
+__attribute__((always_inline))
+static inline size_t parse_ip6_inline(const char *src, void *dst)
+{
+  struct ip6_window window;
+  ip6_classify(&window, src);
+  return ip6_parse(src, dst, &window);
+}
+
+__attribute__((always_inline))
+static inline size_t parse_ip6_prefix_inline(
+  const char *src, void *dst, uint8_t *prefix)
+{
+  struct ip6_window window;
+  ip6_classify(&window, src);
+  const size_t size = ip6_parse(src, dst, &window);
+  if (!size)
+    return 0u;
+  return ip6_parse_prefix(src, size, prefix, &window);
+}
+
+#endif // SSE41_H
@@ -0,0 +1,64 @@
+/*
+ * stats.c -- collect and write the counters of the parsers
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ip6.h"
+#include "patterns.h"
+#include "groups.h"
+
+_Static_assert(sizeof(patterns) / sizeof(patterns[0]) <= IP6_STATS_PATTERNS,
+  "too many patterns to count");
+_Static_assert(GROUP_KEYS == IP6_STATS_GROUPS, "too many groups to count");
+
+_Thread_local ip6_stats_t ip6_thread_stats;
+
+void ip6_stats_collect(ip6_stats_t *stats)
+{
+  const uint64_t *counters = (const uint64_t *)&ip6_thread_stats;
+  uint64_t *totals = (uint64_t *)stats;
+  for (size_t i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++)
+    totals[i] += counters[i];
+  memset(&ip6_thread_stats, 0, sizeof(ip6_thread_stats));
+}
+
+int ip6_stats_dump(FILE *file, const ip6_stats_t *stats)
+{
+  static const char *rejects[IP6_REJECTS] = {
+    "leading-colon", "pattern", "embedded", "delimiter",
+    "trailing-colon", "compressed", "groups"
+  };
+
+  fprintf(file, "parsed %" PRIu64 "\n", stats->parsed);
+  fprintf(file, "full %" PRIu64 "\n", stats->full);
+  for (size_t i = 0; i < IP6_REJECTS; i++)
+    fprintf(file, "reject %s %" PRIu64 "\n", rejects[i], stats->rejects[i]);
+  for (size_t i = 0; i < IP6_STATS_ITERATIONS; i++)
+    fprintf(file, "iterations %zu %" PRIu64 "\n", i, stats->iterations[i]);
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+    if (!stats->patterns[i])
+      continue;
+    char mask[PATTERN_BITS + 1];
+    for (uint32_t bit = 0; bit < PATTERN_BITS; bit++)
+      mask[bit] = (patterns[i].mask & (1u << bit)) ? '1' : '0';
+    mask[PATTERN_BITS] = '\0';
+    fprintf(file, "pattern %zu %s %" PRIu64 "\n", i, mask, stats->patterns[i]);
+  }
+  // widths of the four groups, first group first
+  for (size_t i = 0; i < GROUP_KEYS; i++) {
+    if (!stats->groups[i])
+      continue;
+    fprintf(file, "widths %zu %zu%zu%zu%zu %" PRIu64 "\n", i, i % 5, i / 5 % 5,
+            i / 25 % 5, i / 125, stats->groups[i]);
+  }
+  fprintf(file, "misses %" PRIu64 "\n", stats->misses);
+  return ferror(file) ? -1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * stats.h -- optional counters of the SSE 4.1 and AVX2 parsers
+ *
+ * Copyright (c) 2025, Jeroen Koekkoek
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+#ifndef STATS_H
+#define STATS_H
+
+// compiled in if IP6_STATS is defined, the macros expand to nothing (or the
+// value returned) otherwise. counters are per thread and are not atomic
+
+#if defined(IP6_STATS)
+#include <stdint.h>
+
+typedef enum {
+  IP6_REJECT_LEADING_COLON, // :abcd
+  IP6_REJECT_PATTERN, // no pattern matches, e.g. a group of five digits
+  IP6_REJECT_EMBEDDED, // invalid dotted quad
+  IP6_REJECT_DELIMITER, // colon or dot after the address
+  IP6_REJECT_TRAILING_COLON, // abcd:
+  IP6_REJECT_COMPRESSED, // more than one ::, or :: and eight groups
+  IP6_REJECT_GROUPS, // fewer than eight groups
+  IP6_REJECTS
+} ip6_reject_t;
+
+#define IP6_STATS_PATTERNS (64)
+#define IP6_STATS_GROUPS (625)
+#define IP6_STATS_ITERATIONS (8)
+
+typedef struct ip6_stats ip6_stats_t;
+struct ip6_stats {
+  uint64_t parsed; // addresses
+  uint64_t full; // of which converted by the full-form path
+  uint64_t rejects[IP6_REJECTS];
+  // windows loaded after the first per address, the last counts the rest
+  uint64_t iterations[IP6_STATS_ITERATIONS];
+  // lookups per id in patterns (two groups) and per key in group_shuffles
+  // (four groups), lookups that find no pattern for the mask are misses
+  uint64_t patterns[IP6_STATS_PATTERNS];
+  uint64_t groups[IP6_STATS_GROUPS];
+  uint64_t misses;
+};
+
+extern __attribute__((visibility("default")))
+_Thread_local ip6_stats_t ip6_thread_stats;
+
+#define IP6_COUNT(counter) \
+  ((void)(ip6_thread_stats.counter++))
+#define IP6_COUNT_ITERATIONS(count) \
+  ((void)(ip6_thread_stats.iterations[ \
+    (count) < IP6_STATS_ITERATIONS ? (count) : IP6_STATS_ITERATIONS - 1]++))
+#define IP6_COUNT_PATTERN(id, hit) \
+  ((void)((hit) ? ip6_thread_stats.patterns[(id)]++ : ip6_thread_stats.misses++))
+#define IP6_COUNT_GROUPS(key, hit) \
+  ((void)((hit) ? ip6_thread_stats.groups[(key)]++ : ip6_thread_stats.misses++))
+#define IP6_REJECT(reason) \
+  (ip6_thread_stats.rejects[IP6_REJECT_ ## reason]++, 0u)
+#else
+#define IP6_COUNT(counter) ((void)0)
+#define IP6_COUNT_PATTERN(id, hit) ((void)0)
+#define IP6_COUNT_GROUPS(key, hit) ((void)0)
+#define IP6_COUNT_ITERATIONS(count) ((void)(count))
+#define IP6_REJECT(reason) (0u)
+#endif
+
+#endif // STATS_H
@@ -4,11 +4,20 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <netdb.h>
 
 #include "benchmark.h"
 
 extern bool hash_lookup(const char *str, size_t len, uint16_t *port);
 extern bool compile_trie_lookup(const char *str, size_t len, uint16_t *port);
+extern bool services_lookup(const char *str, size_t len, uint16_t *port);
+extern bool registry_lookup(const char *str, size_t len, uint16_t *port);
+extern bool registry_lookup_reverse(uint16_t port, const char **name, size_t *length);
+extern size_t registry_lookup_reverse_bitmap(
+  const uint8_t *bitmap, size_t size,
+  uint16_t *ports, const char **names, uint8_t *lengths, size_t count);
+extern void hash_lookup_batch(
+  const char **names, const size_t *lens, size_t n, uint16_t *ports, uint8_t *found);
 
 typedef struct service service_t;
 struct service { char name[16]; size_t length; };
@@ -47,6 +56,54 @@ static const size_t service_count = sizeof(services)/sizeof(services[0]);
 
 #define error(message) (void)(printf(message "\n")), exit(EXIT_FAILURE)
 
+// names from the keyword list registry_lookup is generated from
+static service_t *load_registry(const char *path, size_t *count, uint16_t **ports)
+{
+  FILE *file;
+  service_t *registry = NULL;
+  size_t capacity = 0;
+  *ports = NULL;
+  char name[64];
+  unsigned port;
+
+  *count = 0;
+  if (!(file = fopen(path, "r")))
+    return NULL;
+  while (fscanf(file, "%63s %u", name, &port) == 2) {
+    if (*count == capacity) {
+      capacity = capacity ? 2 * capacity : 1024;
+      if (!(registry = realloc(registry, capacity * sizeof(*registry))) ||
+          !(*ports = realloc(*ports, capacity * sizeof(**ports))))
+        error("failed to allocate memory");
+    }
+    (*ports)[*count] = (uint16_t)port;
+    service_t *service = &registry[(*count)++];
+    memset(service, 0, sizeof(*service));
+    service->length = strlen(name);
+    memcpy(service->name, name, service->length);
+  }
+  fclose(file);
+  return registry;
+}
+
+static bool getservbyname_lookup(const char *str, uint16_t *port)
+{
+  const struct servent *servent = getservbyname(str, NULL);
+  if (!servent)
+    return false;
+  *port = (uint16_t)ntohs((uint16_t)servent->s_port);
+  return true;
+}
+
+static bool getservbyport_lookup(uint16_t port, const char **name)
+{
+  const struct servent *servent = getservbyport(htons(port), NULL);
+  if (!servent)
+    return false;
+  *name = servent->s_name;
+  return true;
+}
+
 int main(int argc, char *argv[])
 {
   (void)argc;
@@ -76,5 +133,122 @@ int main(int argc, char *argv[])
   BEST_TIME(/**/,
     compile_trie_lookup(test_data[i].name, test_data[i].length, &port),
     "compile_trie_lookup", count, 1);
+  BEST_TIME(/**/,
+    services_lookup(test_data[i].name, test_data[i].length, &port),
+    "services_lookup", count, 1);
+  BEST_TIME(/**/,
+    registry_lookup(test_data[i].name, test_data[i].length, &port),
+    "registry_lookup", count, 1);
+
+  // batches of names, checked against one lookup at a time
+  const char **names;
+  size_t *lens;
+  uint16_t *ports;
+  uint8_t *found;
+  if (!(names = calloc(count, sizeof(*names))) ||
+      !(lens = calloc(count, sizeof(*lens))) ||
+      !(ports = calloc(count, sizeof(*ports))) ||
+      !(found = calloc(count, sizeof(*found))))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < count; i++) {
+    names[i] = test_data[i].name;
+    lens[i] = test_data[i].length;
+  }
+  hash_lookup_batch(names, lens, count, ports, found);
+  for (size_t i = 0; i < count; i++) {
+    const bool match = hash_lookup(names[i], lens[i], &port);
+    if (match != found[i] || port != ports[i])
+      error("hash_lookup_batch does not match hash_lookup");
+  }
+
+  BEST_TIME(/**/,
+    for (size_t j = 0; j < count; j++)
+      found[j] = hash_lookup(names[j], lens[j], &ports[j]),
+    "hash_lookup (loop)", 1, count);
+  BEST_TIME(/**/,
+    hash_lookup_batch(names, lens, count, ports, found),
+    "hash_lookup_batch", 1, count);
+
+  free(names);
+  free(lens);
+  free(ports);
+  free(found);
+
+  size_t registry_count;
+  service_t *registry;
+  uint16_t *registry_ports;
+  if (!(registry = load_registry("registry.keys", &registry_count, &registry_ports)) ||
+      !registry_count)
+    error("failed to load registry.keys");
+
+  printf("generating test data (registry, %zu names)\n", registry_count);
+  for (size_t i = 0; i < count; i++)
+    test_data[i] = registry[ random() % registry_count ];
+  for (size_t i = 0; i < registry_count; i++) {
+    if (!registry_lookup(registry[i].name, registry[i].length, &port))
+      error("registry_lookup misses a name from registry.keys");
+  }
+
+  BEST_TIME(/**/,
+    registry_lookup(test_data[i].name, test_data[i].length, &port),
+    "registry_lookup", count, 1);
+  // getservbyname reads the services database on every call
+  BEST_TIME(/**/,
+    getservbyname_lookup(test_data[i].name, &port),
+    "getservbyname", count / 1000, 1);
+
+  // names by port, each must map back to the same port
+  uint16_t *test_ports;
+  if (!(test_ports = calloc(count, sizeof(*test_ports))))
+    error("failed to allocate memory");
+  for (size_t i = 0; i < registry_count; i++) {
+    const char *name;
+    size_t length;
+    char padded[16] = { 0 };
+    if (!registry_lookup_reverse(registry_ports[i], &name, &length))
+      error("registry_lookup_reverse misses a port from registry.keys");
+    memcpy(padded, name, length);
+    if (!registry_lookup(padded, length, &port) || port != registry_ports[i])
+      error("registry_lookup_reverse does not match registry_lookup");
+  }
+  for (size_t i = 0; i < count; i++)
+    test_ports[i] = registry_ports[ random() % registry_count ];
+
+  const char *name;
+  size_t length;
+  BEST_TIME(/**/,
+    registry_lookup_reverse(test_ports[i], &name, &length),
+    "registry_lookup_reverse", count, 1);
+  BEST_TIME(/**/,
+    getservbyport_lookup(test_ports[i], &name),
+    "getservbyport", count / 1000, 1);
+
+  // a WKS bitmap with every port below 1024 that has a name
+  uint8_t bitmap[128] = { 0 };
+  uint16_t ports_found[1024];
+  const char *names_found[1024];
+  uint8_t lengths_found[1024];
+  size_t named = 0;
+  for (size_t i = 0; i < registry_count; i++) {
+    const uint16_t wks_port = registry_ports[i];
+    const uint8_t bit = (uint8_t)(0x80u >> (wks_port % 8));
+    if (wks_port < 1024 && !(bitmap[wks_port / 8] & bit)) {
+      bitmap[wks_port / 8] |= bit;
+      named++;
+    }
+  }
+  if (registry_lookup_reverse_bitmap(
+        bitmap, sizeof(bitmap), ports_found, names_found, lengths_found, 1024) != named)
+    error("registry_lookup_reverse_bitmap misses a port");
+  printf("bitmap of %zu ports\n", named);
+  BEST_TIME(/**/,
+    registry_lookup_reverse_bitmap(
+      bitmap, sizeof(bitmap), ports_found, names_found, lengths_found, 1024),
+    "registry_lookup_reverse_bitmap", 1000, named);
+
+  free(test_ports);
+  free(registry_ports);
+  free(registry);
+  free(test_data);
   return 0;
 }
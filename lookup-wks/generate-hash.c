@@ -1,103 +1,729 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
 
-typedef struct tuple tuple_t;
-struct tuple {
-  char name[16];
-  uint16_t code;
+// generate a case-insensitive lookup function for a list of keywords. the
+// input holds a keyword and a value per line, empty lines and lines that
+// start with '#' are ignored:
+//
+//   # name  port
+//   domain  53
+//   http    80
+//
+// keywords are at most 16 bytes. the hash folds both 8-byte halves of the
+// keyword (upper case, bytes past the length zeroed) into 32 bits, multiplies
+// by a magic and adds the length. magics are tried for the smallest table
+// first, the table is doubled if none is collision-free
+
+typedef struct keyword keyword_t;
+struct keyword {
+  char name[16]; // lower case, zero padded
+  size_t length;
+  uint16_t value;
+  size_t line;
 };
 
-static const tuple_t services[] = {
-  { "tcpmux", 1 },
-  { "echo", 7 },
-  { "ftp-data", 20 },
-  { "ftp", 21 },
-  { "ssh", 22 },
-  { "telnet", 23 },
-  { "lmtp", 24 },
-  { "smtp", 25 },
-  { "nicname", 43 },
-  { "domain", 53 },
-  { "whoispp", 63 },
-  { "http", 80 },
-  { "kerberos", 88 },
-  { "npp", 92 },
-  { "pop3", 110 },
-  { "nntp", 119 },
-  { "ntp", 123 },
-  { "imap", 143 },
-  { "snmp", 161 },
-  { "snmptrap", 162 },
-  { "bgmp", 264 },
-  { "ptp-event", 319 },
-  { "ptp-general", 320 },
-  { "nnsp", 433 },
-  { "https", 443 },
-  { "submission", 587 },
-  // FIXME: submissions cannot be distinguished from submission by hash value
-  //        because the shared prefix is too long. it makes sense to calculate
-  //        the hash over the suffix rather then the prefix or include the
-  //        length
-  { "submissions", 465 },
-  { "nntps", 563 },
-  { "ldaps", 636 },
-  { "domain-s", 853 },
-  { "ftps-data", 989 },
-  { "ftps", 990 },
-  { "imaps", 993 },
-  { "pop3s", 995 }
+// convert to lower case, unconditionally transforms characters 0x40-0x5f and
+// 0xc0-0xdf, exactly as the generated lookup does for its input
+static char lower(char c)
+{
+  return (char)(c | ((c & 0x40) >> 1));
+}
+
+static uint32_t fold(const keyword_t *keyword)
+{
+  uint64_t input0, input1;
+  memcpy(&input0, keyword->name, 8);
+  memcpy(&input1, keyword->name + 8, 8);
+  // convert to upper case, unconditionally transforms digits and dash too
+  const uint64_t key = (input0 ^ input1) & 0xdfdfdfdfdfdfdfdfllu;
+  return (uint32_t)((key >> 32) ^ key);
+}
+
+static uint32_t hash(uint32_t folded, uint64_t magic, size_t length, uint32_t mask)
+{
+  return (uint32_t)((((folded * magic) >> 32) + length) & mask);
+}
+
+// magics are drawn from a fixed sequence so that output is reproducible
+static uint64_t next_magic(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15llu);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+  return (z ^ (z >> 31)) & 0xffffffffllu;
+}
+
+static int parse(FILE *file, const char *path, keyword_t **keywords, size_t *count)
+{
+  char line[256];
+  size_t capacity = 0, lines = 0;
+
+  *keywords = NULL;
+  *count = 0;
+  while (fgets(line, sizeof(line), file)) {
+    char name[64];
+    unsigned long value;
+    int end = 0;
+
+    lines++;
+    sscanf(line, " %n", &end);
+    if (!line[end] || line[end] == '#')
+      continue;
+    if (sscanf(line, "%63s %lu %n", name, &value, &end) != 2 || line[end]) {
+      fprintf(stderr, "%s:%zu: expected a keyword and a value\n", path, lines);
+      return -1;
+    }
+    const size_t length = strlen(name);
+    if (length > sizeof((*keywords)->name) || value > UINT16_MAX) {
+      fprintf(stderr, "%s:%zu: keyword longer than 16 bytes or value "
+                      "out of range\n", path, lines);
+      return -1;
+    }
+
+    if (*count == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      keyword_t *resized = realloc(*keywords, capacity * sizeof(**keywords));
+      if (!resized)
+        return -1;
+      *keywords = resized;
+    }
+    keyword_t *keyword = &(*keywords)[(*count)++];
+    memset(keyword, 0, sizeof(*keyword));
+    keyword->length = length;
+    for (size_t i = 0; i < length && i < sizeof(keyword->name); i++)
+      keyword->name[i] = lower(name[i]);
+    keyword->value = (uint16_t)value;
+    keyword->line = lines;
+  }
+
+  // keywords that are equal after folding cannot be told apart by any magic
+  for (size_t i = 0; i < *count; i++) {
+    for (size_t j = i + 1; j < *count; j++) {
+      const keyword_t *a = &(*keywords)[i], *b = &(*keywords)[j];
+      if (a->length == b->length && fold(a) == fold(b)) {
+        fprintf(stderr, "%s:%zu: keyword cannot be distinguished from the "
+                        "keyword on line %zu\n", path, b->line, a->line);
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// find a magic for the smallest table of at most max_slots slots
+static bool search(
+  const keyword_t *keywords, size_t count, size_t max_slots, uint64_t tries,
+  uint64_t *magic, uint32_t *slots)
+{
+  uint32_t *folded = malloc((count ? count : 1) * sizeof(*folded));
+  uint8_t *used = NULL;
+  if (!folded)
+    return false;
+  for (size_t i = 0; i < count; i++)
+    folded[i] = fold(&keywords[i]);
+
+  // 64 bits, doubling past a max_slots of 2^31 must not wrap to zero
+  uint64_t size = 1;
+  while (size < count)
+    size *= 2;
+  for (; size <= max_slots; size *= 2) {
+    free(used);
+    if (!(used = malloc(size)))
+      break;
+    uint64_t state = size;
+    for (uint64_t try = 0; try < tries; try++) {
+      const uint64_t candidate = next_magic(&state);
+      size_t i;
+      memset(used, 0, size);
+      for (i = 0; i < count; i++) {
+        const uint32_t key = hash(folded[i], candidate, keywords[i].length, (uint32_t)(size - 1));
+        if (used[key])
+          break;
+        used[key] = 1;
+      }
+      if (i == count) {
+        *magic = candidate;
+        *slots = (uint32_t)size;
+        free(used);
+        free(folded);
+        return true;
+      }
+    }
+  }
+
+  free(used);
+  free(folded);
+  return false;
+}
+
+// hash and displace for larger keyword sets. the product of the key and the
+// magic selects a bucket (top bits) and a slot (bits 32 and up), the slot is
+// xor-ed with the displacement of the bucket. buckets hold four keywords on
+// average and are placed largest first, a displacement is found for each
+// that moves its keywords to free slots. a lookup takes one load from the
+// displacements and one from the table
+typedef struct displaced displaced_t;
+struct displaced {
+  uint64_t magic;
+  uint32_t slots, buckets, bucket_bits;
+  uint16_t *displacements;
 };
 
-const uint64_t original_magic = 138261570llu; // established after first run
+static uint64_t product(uint32_t folded, uint64_t magic, size_t length)
+{
+  return (((uint64_t)length << 32) | folded) * magic;
+}
 
-static uint8_t hash(uint64_t magic, uint64_t value, size_t length)
+static uint32_t displaced_slot(const displaced_t *displaced, uint32_t folded, size_t length)
 {
-  // ensure upper case modifies numbers and dashes unconditionally too,
-  // but does not intruduce clashes
-  value &= 0xdfdfdfdfdfdfdfdfllu;
-  uint32_t value32 = ((value >> 32) ^ value);
-  return (((value32 * magic) >> 32) + length) & 0x3f;
+  const uint64_t x = product(folded, displaced->magic, length);
+  const uint16_t displacement = displaced->displacements[x >> (64 - displaced->bucket_bits)];
+  return ((uint32_t)(x >> 32) ^ displacement) & (displaced->slots - 1);
 }
 
-int main(int argc, char *argv[])
+static int compare_buckets(const void *a, const void *b)
 {
-  const size_t n = sizeof(services)/sizeof(services[0]);
-  for (uint64_t magic = original_magic; magic < UINT64_MAX; magic++) {
-    size_t i;
-    uint16_t keys[256] = { 0 };
-    for (i=0; i < n; i++) {
-      uint64_t value;
-      memcpy(&value, services[i].name, 8);
+  const uint32_t *x = a, *y = b;
+  // by size, largest first
+  return x[1] != y[1] ? (x[1] < y[1] ? 1 : -1) : (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+// place keywords bucket by bucket, returns false if a bucket does not fit
+static bool place(
+  const uint32_t *folded, const keyword_t *keywords, size_t count,
+  displaced_t *displaced, uint32_t *order, uint32_t (*buckets)[2], uint8_t *used)
+{
+  const uint32_t slots = displaced->slots, shift = 64 - displaced->bucket_bits;
+  uint32_t *starts = buckets[0] + 2 * displaced->buckets;
+
+  // counting sort of keywords by bucket
+  for (uint32_t i = 0; i < displaced->buckets; i++)
+    buckets[i][0] = i, buckets[i][1] = 0;
+  for (size_t i = 0; i < count; i++)
+    buckets[product(folded[i], displaced->magic, keywords[i].length) >> shift][1]++;
+  for (uint32_t i = 0, start = 0; i < displaced->buckets; i++)
+    starts[i] = start, start += buckets[i][1];
+  for (size_t i = 0; i < count; i++)
+    order[starts[product(folded[i], displaced->magic, keywords[i].length) >> shift]++] = (uint32_t)i;
+  for (uint32_t i = 0; i < displaced->buckets; i++)
+    starts[i] -= buckets[i][1];
+  qsort(buckets, displaced->buckets, sizeof(*buckets), compare_buckets);
 
-      uint8_t key = hash(magic, value, strlen(services[i].name));
-      if (keys[key])
+  memset(used, 0, slots);
+  for (uint32_t i = 0; i < displaced->buckets && buckets[i][1]; i++) {
+    const uint32_t bucket = buckets[i][0], size = buckets[i][1];
+    const uint32_t *members = &order[starts[bucket]];
+    uint32_t displacement, placed = 0;
+    for (displacement = 0; displacement < slots; displacement++) {
+      for (placed = 0; placed < size; placed++) {
+        const uint32_t keyword = members[placed];
+        const uint32_t slot = ((uint32_t)(product(
+          folded[keyword], displaced->magic, keywords[keyword].length) >> 32) ^
+          displacement) & (slots - 1);
+        if (used[slot])
+          break;
+        used[slot] = 1;
+      }
+      if (placed == size)
         break;
-      keys[key] = 1;
+      // undo the slots taken so far
+      for (uint32_t j = 0; j < placed; j++) {
+        const uint32_t keyword = members[j];
+        used[((uint32_t)(product(
+          folded[keyword], displaced->magic, keywords[keyword].length) >> 32) ^
+          displacement) & (slots - 1)] = 0;
+      }
     }
+    if (displacement == slots)
+      return false;
+    displaced->displacements[bucket] = (uint16_t)displacement;
+  }
 
-    if (i == n) {
-      struct { const char *name; uint16_t port; } table[64] = { 0 };
-      printf("services: %zu, magic: %" PRIu64 "\n", i, magic);
-      for (i=0; i < n; i++) {
-        uint64_t value;
-        memcpy(&value, services[i].name, 8);
-        uint8_t key = hash(magic, value, strlen(services[i].name));
-        table[key].name = services[i].name;
-        table[key].port = services[i].code;
-      }
-      for (uint8_t key=0; key < sizeof(table)/sizeof(table[0]); key++) {
-        if (table[key].port)
-          printf("  SERVICE(\"%s\", %u),\n", table[key].name, table[key].port);
-        else
-          printf("  UNKNOWN_SERVICE(),\n");
+  return true;
+}
+
+static bool search_displaced(
+  const keyword_t *keywords, size_t count, size_t max_slots, uint64_t tries,
+  displaced_t *displaced)
+{
+  uint32_t *folded = malloc((count ? count : 1) * sizeof(*folded));
+  uint32_t *order = malloc((count ? count : 1) * sizeof(*order));
+  if (!folded || !order) {
+    free(folded);
+    free(order);
+    return false;
+  }
+  for (size_t i = 0; i < count; i++)
+    folded[i] = fold(&keywords[i]);
+
+  // displacements are 16 bits
+  if (max_slots > 65536)
+    max_slots = 65536;
+
+  uint32_t size = 8;
+  while (size < count)
+    size *= 2;
+  for (; size <= max_slots; size *= 2) {
+    uint32_t bucket_bits = 1;
+    while ((1u << (bucket_bits + 2)) < size)
+      bucket_bits++;
+    const uint32_t buckets = 1u << bucket_bits;
+
+    uint32_t (*sizes)[2] = malloc(buckets * 3 * sizeof(uint32_t));
+    uint8_t *used = malloc(size);
+    uint16_t *displacements = calloc(buckets, sizeof(*displacements));
+    if (!sizes || !used || !displacements) {
+      free(sizes);
+      free(used);
+      free(displacements);
+      break;
+    }
+
+    uint64_t state = size;
+    for (uint64_t try = 0; try < tries; try++) {
+      *displaced = (displaced_t){
+        ((next_magic(&state) << 32) | next_magic(&state)) | 1u,
+        size, buckets, bucket_bits, displacements };
+      if (place(folded, keywords, count, displaced, order, sizes, used)) {
+        free(sizes);
+        free(used);
+        free(folded);
+        free(order);
+        return true;
       }
-      return 0;
     }
+
+    free(sizes);
+    free(used);
+    free(displacements);
+  }
+
+  free(folded);
+  free(order);
+  return false;
+}
+
+static void print_name(FILE *file, const keyword_t *keyword)
+{
+  fputc('"', file);
+  for (size_t i = 0; i < keyword->length; i++) {
+    const unsigned char c = (unsigned char)keyword->name[i];
+    if (c == '"' || c == '\\')
+      fprintf(file, "\\%c", c);
+    else if (c < 0x20 || c > 0x7e)
+      fprintf(file, "\\%03o", c);
+    else
+      fputc(c, file);
+  }
+  fputc('"', file);
+}
+
+static void emit_header(FILE *file, const char *path, const char *name)
+{
+  fprintf(file,
+    "// generated by generate-hash from %s, do not edit\n"
+    "#include <stdbool.h>\n"
+    "#include <stdint.h>\n"
+    "#include <string.h>\n"
+    "#include <endian.h>\n"
+    "\n"
+    "typedef struct %s_entry %s_entry_t;\n"
+    "struct %s_entry {\n"
+    "  const char name[16];\n"
+    "  size_t length;\n"
+    "  uint16_t value;\n"
+    "} __attribute__((aligned(32)));\n"
+    "\n",
+    path, name, name, name);
+}
+
+static void emit_entries(
+  FILE *file, const char *name, const keyword_t **table, uint32_t slots)
+{
+  fprintf(file,
+    "#define UNKNOWN_KEYWORD() { \"\", 0, 0 }\n"
+    "#define KEYWORD(name, value) { name, sizeof(name) - 1, value }\n"
+    "\n"
+    "static const %s_entry_t %s_table[%" PRIu32 "] = {\n",
+    name, name, slots);
+  for (uint32_t i = 0; i < slots; i++) {
+    if (table[i]) {
+      fprintf(file, "  KEYWORD(");
+      print_name(file, table[i]);
+      fprintf(file, ", %u),\n", table[i]->value);
+    } else {
+      fprintf(file, "  UNKNOWN_KEYWORD(),\n");
+    }
+  }
+  fprintf(file,
+    "};\n"
+    "\n"
+    "#undef KEYWORD\n"
+    "#undef UNKNOWN_KEYWORD\n"
+    "\n");
+}
+
+// the lookup function, hash for the key selects the entry to compare against
+static void emit_lookup(FILE *file, const char *name)
+{
+  fprintf(file,
+    "// str must have 16 readable bytes, bytes past len are ignored\n"
+    "bool %s(const char *str, size_t len, uint16_t *value)\n"
+    "{\n"
+    "  static const int8_t zero_masks[48] = {\n"
+    "    -1, -1, -1, -1, -1, -1, -1, -1,\n"
+    "    -1, -1, -1, -1, -1, -1, -1, -1,\n"
+    "    -1, -1, -1, -1, -1, -1, -1, -1,\n"
+    "    -1, -1, -1, -1, -1, -1, -1, -1,\n"
+    "     0,  0,  0,  0,  0,  0,  0,  0,\n"
+    "     0,  0,  0,  0,  0,  0,  0,  0\n"
+    "  };\n"
+    "\n"
+    "  if (len == 0 || len > 16)\n"
+    "    return false;\n"
+    "\n"
+    "  uint64_t input0, input1;\n"
+    "  static const uint64_t upper_mask = 0xdfdfdfdfdfdfdfdfllu;\n"
+    "  static const uint64_t letter_mask = 0x4040404040404040llu;\n"
+    "  memcpy(&input0, str, 8);\n"
+    "  memcpy(&input1, str+8, 8);\n"
+    "  // zero out non-relevant bytes\n"
+    "  uint64_t zero_mask0, zero_mask1;\n"
+    "  const int8_t *zero_mask = &zero_masks[32 - len];\n"
+    "  memcpy(&zero_mask0, zero_mask, 8);\n"
+    "  memcpy(&zero_mask1, zero_mask+8, 8);\n"
+    "  input0 &= zero_mask0;\n"
+    "  input1 &= zero_mask1;\n"
+    "  // convert to upper case, unconditionally transforms digits (0x30-0x39)\n"
+    "  // and dash (0x2d), but does not introduce clashes\n"
+    "  uint64_t key = (input0 ^ input1) & upper_mask;\n"
+    "  uint32_t index = %s_hash(key, len);\n"
+    "\n"
+    "  // convert to lower case for the compare\n"
+    "  input0 |= (input0 & letter_mask) >> 1;\n"
+    "  input1 |= (input1 & letter_mask) >> 1;\n"
+    "\n"
+    "  uint64_t name0, name1;\n"
+    "  memcpy(&name0, %s_table[index].name, 8);\n"
+    "  memcpy(&name1, %s_table[index].name+8, 8);\n"
+    "\n"
+    "  *value = %s_table[index].value;\n"
+    "  return\n"
+    "    (input0 == name0) & (input1 == name1) & (%s_table[index].length == len);\n"
+    "}\n",
+    name, name, name, name, name, name);
+}
+
+static bool emit(
+  FILE *file, const char *path, const char *name,
+  const keyword_t *keywords, size_t count, uint64_t magic, uint32_t slots)
+{
+  const keyword_t **table;
+  if (!(table = calloc(slots, sizeof(*table))))
+    return false;
+  for (size_t i = 0; i < count; i++)
+    table[hash(fold(&keywords[i]), magic, keywords[i].length, slots - 1)] = &keywords[i];
+
+  emit_header(file, path, name);
+  emit_entries(file, name, table, slots);
+  fprintf(file,
+    "// keywords: %zu, slots: %" PRIu32 ", magic: %" PRIu64 "\n"
+    "__attribute__((always_inline))\n"
+    "static inline uint32_t %s_hash(uint64_t input, size_t length)\n"
+    "{\n"
+    "  // le64toh is required for big endian, no-op on little endian\n"
+    "  input = le64toh(input);\n"
+    "  uint32_t input32 = ((input >> 32) ^ input);\n"
+    "  return (((input32 * %" PRIu64 "llu) >> 32) + length) & 0x%" PRIx32 ";\n"
+    "}\n"
+    "\n",
+    count, slots, magic, name, magic, slots - 1);
+  emit_lookup(file, name);
+
+  free(table);
+  return true;
+}
+
+static bool emit_displaced(
+  FILE *file, const char *path, const char *name,
+  const keyword_t *keywords, size_t count, const displaced_t *displaced)
+{
+  const keyword_t **table;
+  if (!(table = calloc(displaced->slots, sizeof(*table))))
+    return false;
+  for (size_t i = 0; i < count; i++)
+    table[displaced_slot(displaced, fold(&keywords[i]), keywords[i].length)] = &keywords[i];
+
+  emit_header(file, path, name);
+  emit_entries(file, name, table, displaced->slots);
+  fprintf(file,
+    "static const uint16_t %s_displacements[%" PRIu32 "] = {",
+    name, displaced->buckets);
+  for (uint32_t i = 0; i < displaced->buckets; i++)
+    fprintf(file, "%s%5" PRIu16 ",", i % 10 ? " " : "\n  ", displaced->displacements[i]);
+  fprintf(file,
+    "\n};\n"
+    "\n"
+    "// keywords: %zu, slots: %" PRIu32 ", buckets: %" PRIu32 ", magic: %" PRIu64 "\n"
+    "__attribute__((always_inline))\n"
+    "static inline uint32_t %s_hash(uint64_t input, size_t length)\n"
+    "{\n"
+    "  // le64toh is required for big endian, no-op on little endian\n"
+    "  input = le64toh(input);\n"
+    "  uint32_t input32 = ((input >> 32) ^ input);\n"
+    "  uint64_t product = (((uint64_t)length << 32) | input32) * %" PRIu64 "llu;\n"
+    "  // the top bits select the bucket, its displacement the slot\n"
+    "  uint16_t displacement = %s_displacements[product >> %u];\n"
+    "  return ((uint32_t)(product >> 32) ^ displacement) & 0x%" PRIx32 ";\n"
+    "}\n"
+    "\n",
+    count, displaced->slots, displaced->buckets, displaced->magic,
+    name, displaced->magic, name, 64 - displaced->bucket_bits,
+    displaced->slots - 1);
+  emit_lookup(file, name);
+
+  free(table);
+  return true;
+}
+
+// reverse index from value to the first keyword listed with it. a bitmap
+// over the values is stored 64 bits at a time next to the number of values
+// in preceding words (rank), the popcount of the bits below a value adds
+// its position within the word. a lookup touches the word and one entry
+static bool emit_reverse(
+  FILE *file, const char *name, const keyword_t *keywords, size_t count)
+{
+  uint64_t bits[1024] = { 0 };
+  const keyword_t **first;
+  if (!(first = calloc(65536, sizeof(*first))))
+    return false;
+  uint32_t words = 0, values = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t value = keywords[i].value;
+    if (first[value])
+      continue;
+    first[value] = &keywords[i];
+    bits[value >> 6] |= 1llu << (value & 63);
+    if ((value >> 6) >= words)
+      words = (value >> 6) + 1u;
+    values++;
+  }
+
+  fprintf(file,
+    "\n"
+    "typedef struct %s_rank %s_rank_t;\n"
+    "struct %s_rank {\n"
+    "  uint64_t bits;\n"
+    "  uint32_t rank;\n"
+    "} __attribute__((aligned(16)));\n"
+    "\n"
+    "static const %s_rank_t %s_ranks[%" PRIu32 "] = {\n",
+    name, name, name, name, name, words);
+  for (uint32_t i = 0, rank = 0; i < words; i++) {
+    fprintf(file, "  { 0x%016" PRIx64 "llu, %" PRIu32 " },\n", bits[i], rank);
+    rank += (uint32_t)__builtin_popcountll(bits[i]);
+  }
+  fprintf(file,
+    "};\n"
+    "\n"
+    "#define KEYWORD(name, value) { name, sizeof(name) - 1, value }\n"
+    "\n"
+    "// keywords by value, the first listed for each\n"
+    "static const %s_entry_t %s_names[%" PRIu32 "] = {\n",
+    name, name, values);
+  for (uint32_t value = 0; value < 65536; value++) {
+    if (!first[value])
+      continue;
+    fprintf(file, "  KEYWORD(");
+    print_name(file, first[value]);
+    fprintf(file, ", %" PRIu32 "),\n", value);
+  }
+  fprintf(file,
+    "};\n"
+    "\n"
+    "#undef KEYWORD\n"
+    "\n"
+    "// name of the first keyword listed for value, names are not null\n"
+    "// terminated\n"
+    "bool %s_reverse(uint16_t value, const char **name, size_t *length)\n"
+    "{\n"
+    "  const uint32_t word = value >> 6;\n"
+    "  const uint64_t bit = 1llu << (value & 63);\n"
+    "  if (word >= %" PRIu32 " || !(%s_ranks[word].bits & bit))\n"
+    "    return false;\n"
+    "  const %s_entry_t *entry = &%s_names[%s_ranks[word].rank +\n"
+    "    (uint32_t)__builtin_popcountll(%s_ranks[word].bits & (bit - 1))];\n"
+    "  *name = entry->name;\n"
+    "  *length = entry->length;\n"
+    "  return true;\n"
+    "}\n"
+    "\n"
+    "// names for the values in a bitmap as found in WKS records (RFC 1035),\n"
+    "// the most significant bit of the first octet is value 0. writes up to\n"
+    "// count values with their names, or NULL and 0 for values without a\n"
+    "// name, returns the number of values written\n"
+    "size_t %s_reverse_bitmap(\n"
+    "  const uint8_t *bitmap, size_t size,\n"
+    "  uint16_t *values, const char **names, uint8_t *lengths, size_t count)\n"
+    "{\n"
+    "  size_t found = 0;\n"
+    "  if (size > 8192)\n"
+    "    size = 8192;\n"
+    "\n"
+    "  for (size_t base = 0; base < size && found < count; base += 8) {\n"
+    "    uint64_t input = 0;\n"
+    "    memcpy(&input, bitmap + base, size - base < 8 ? size - base : 8);\n"
+    "    if (!input)\n"
+    "      continue;\n"
+    "    // reverse the bits in each octet, bit n is value 8 * base + n then\n"
+    "    input = le64toh(input);\n"
+    "    input = ((input >> 1) & 0x5555555555555555llu) | ((input & 0x5555555555555555llu) << 1);\n"
+    "    input = ((input >> 2) & 0x3333333333333333llu) | ((input & 0x3333333333333333llu) << 2);\n"
+    "    input = ((input >> 4) & 0x0f0f0f0f0f0f0f0fllu) | ((input & 0x0f0f0f0f0f0f0f0fllu) << 4);\n"
+    "\n"
+    "    const uint32_t word = (uint32_t)(base / 8);\n"
+    "    const uint64_t bits = word < %" PRIu32 " ? %s_ranks[word].bits : 0;\n"
+    "    const uint32_t rank = word < %" PRIu32 " ? %s_ranks[word].rank : 0;\n"
+    "    for (; input && found < count; input &= input - 1) {\n"
+    "      const uint64_t bit = input & -input;\n"
+    "      values[found] = (uint16_t)(base * 8 + (size_t)__builtin_ctzll(input));\n"
+    "      if (bits & bit) {\n"
+    "        const %s_entry_t *entry =\n"
+    "          &%s_names[rank + (uint32_t)__builtin_popcountll(bits & (bit - 1))];\n"
+    "        names[found] = entry->name;\n"
+    "        lengths[found] = (uint8_t)entry->length;\n"
+    "      } else {\n"
+    "        names[found] = NULL;\n"
+    "        lengths[found] = 0;\n"
+    "      }\n"
+    "      found++;\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  return found;\n"
+    "}\n",
+    name, words, name, name, name, name, name,
+    name, words, name, words, name, name, name);
+
+  free(first);
+  return true;
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+    "usage: %s [-d] [-r] [-n NAME] [-s SLOTS] [-m MAGICS] [-o OUTPUT] KEYWORDS\n"
+    "  -d         hash and displace, for thousands of keywords\n"
+    "  -r         add NAME_reverse() to look up keywords by value\n"
+    "  -n NAME    name of the lookup function (default: lookup)\n"
+    "  -s SLOTS   largest table to consider (default: 65536)\n"
+    "  -m MAGICS  number of magics to try per table size\n"
+    "             (default: 1048576, or 256 with -d)\n"
+    "  -o OUTPUT  write C source to OUTPUT instead of stdout\n",
+    program);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *name = "lookup", *output = NULL;
+  size_t max_slots = 65536;
+  uint64_t tries = 0;
+  bool displace = false, reverse = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "drn:s:m:o:")) != -1) {
+    switch (option) {
+      case 'd':
+        displace = true;
+        break;
+      case 'r':
+        reverse = true;
+        break;
+      case 'n':
+        name = optarg;
+        break;
+      case 's':
+        max_slots = strtoull(optarg, NULL, 10);
+        break;
+      case 'm':
+        if (!(tries = strtoull(optarg, NULL, 10)))
+          usage(argv[0]);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || !max_slots || max_slots > (1u << 31))
+    usage(argv[0]);
+  if (!tries)
+    tries = displace ? 256 : 1u << 20;
+
+  const char *path = argv[optind];
+  FILE *file;
+  if (!(file = fopen(path, "r"))) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  keyword_t *keywords;
+  size_t count;
+  const int result = parse(file, path, &keywords, &count);
+  fclose(file);
+  if (result != 0 || !count) {
+    if (result == 0)
+      fprintf(stderr, "%s: no keywords\n", path);
+    free(keywords);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t magic;
+  uint32_t slots;
+  displaced_t displaced = { 0 };
+  if (displace ? !search_displaced(keywords, count, max_slots, tries, &displaced)
+               : !search(keywords, count, max_slots, tries, &magic, &slots))
+  {
+    fprintf(stderr, "no magic value for %zu keywords in %zu slots\n",
+      count, max_slots);
+    free(keywords);
+    return EXIT_FAILURE;
+  }
+
+  if (displace)
+    fprintf(stderr, "keywords: %zu, slots: %" PRIu32 ", buckets: %" PRIu32
+                    ", magic: %" PRIu64 "\n",
+      count, displaced.slots, displaced.buckets, displaced.magic);
+  else
+    fprintf(stderr, "keywords: %zu, slots: %" PRIu32 ", magic: %" PRIu64 "\n",
+      count, slots, magic);
+  if (!output) {
+    file = stdout;
+  } else if (!(file = fopen(output, "w"))) {
+    fprintf(stderr, "Cannot open %s\n", output);
+    free(keywords);
+    return EXIT_FAILURE;
   }
+  bool written = displace
+    ? emit_displaced(file, path, name, keywords, count, &displaced)
+    : emit(file, path, name, keywords, count, magic, slots);
+  if (written && reverse)
+    written = emit_reverse(file, name, keywords, count);
+  written = !ferror(file) & written;
+  if (file != stdout)
+    written = (fclose(file) == 0) & written;
+  if (!written)
+    fprintf(stderr, "Cannot write %s\n", output ? output : "output");
 
-  printf("no magic value\n");
-  return 1;
+  free(displaced.displacements);
+  free(keywords);
+  return written ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -3,6 +3,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <endian.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 typedef struct service service_t;
 struct service {
@@ -89,13 +92,16 @@ static const service_t services[64] = {
 #undef UNKNOWN_SERVICE
 
 // services: 34, magic: 138261570
+#define SERVICE_MAGIC (138261570llu)
+#define SERVICE_MASK (0x3f)
+
 __attribute__((always_inline))
 static inline uint8_t service_hash(uint64_t input, size_t length)
 {
   // le64toh is required for big endian, no-op on little endian
   input = le64toh(input);
   uint32_t input32 = ((input >> 32) ^ input);
-  return (((input32 * 138261570llu) >> 32) + length) & 0x3f;
+  return (((input32 * SERVICE_MAGIC) >> 32) + length) & SERVICE_MASK;
 }
 
 bool hash_lookup(const char *str, size_t len, uint16_t *port)
@@ -138,3 +144,111 @@ bool hash_lookup(const char *str, size_t len, uint16_t *port)
   return
     (input0 == name0) & (input1 == name1) & (services[index].key.length == len);
 }
+
+#if defined(__AVX2__)
+// entries are addressed as four 64-bit lanes, lengths are loaded as such
+_Static_assert(sizeof(service_t) == 32, "entries must be 32 bytes");
+_Static_assert(sizeof(size_t) == 8, "lengths must be 64 bits");
+
+// hash four names, returns the offsets of their entries in services
+__attribute__((always_inline))
+static inline __m256i service_hash4(__m256i input, __m256i length)
+{
+  const __m256i upper_mask = _mm256_set1_epi64x(0xdfdfdfdfdfdfdfdfll);
+  const __m256i key = _mm256_and_si256(input, upper_mask);
+  const __m256i input32 = _mm256_xor_si256(key, _mm256_srli_epi64(key, 32));
+  const __m256i product =
+    _mm256_mul_epu32(input32, _mm256_set1_epi64x((long long)SERVICE_MAGIC));
+  const __m256i index = _mm256_and_si256(
+    _mm256_add_epi64(_mm256_srli_epi64(product, 32), length),
+    _mm256_set1_epi64x(SERVICE_MASK));
+  return _mm256_slli_epi64(index, 5);
+}
+
+// compare four names against their entries, returns a mask of the matches
+__attribute__((always_inline))
+static inline uint32_t service_compare4(
+  __m256i input0, __m256i input1, __m256i length, __m256i offset, __m256i *port)
+{
+  const long long *base = (const long long *)services;
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  const __m256i letter_mask = _mm256_set1_epi64x(0x4040404040404040ll);
+  const __m256i bits = _mm256_slli_epi64(length, 3);
+  // zero out non-relevant bytes, shifts by 64 bits or more yield zero
+  const __m256i zero_mask0 = _mm256_andnot_si256(_mm256_sllv_epi64(ones, bits), ones);
+  const __m256i zero_mask1 = _mm256_andnot_si256(_mm256_sllv_epi64(ones,
+    _mm256_sub_epi64(_mm256_max_epu32(bits, _mm256_set1_epi64x(64)),
+                     _mm256_set1_epi64x(64))), ones);
+
+  input0 = _mm256_or_si256(input0,
+    _mm256_srli_epi64(_mm256_and_si256(input0, letter_mask), 1));
+  input0 = _mm256_and_si256(input0, zero_mask0);
+  input1 = _mm256_or_si256(input1,
+    _mm256_srli_epi64(_mm256_and_si256(input1, letter_mask), 1));
+  input1 = _mm256_and_si256(input1, zero_mask1);
+
+  const __m256i name0 = _mm256_i64gather_epi64(base, offset, 1);
+  const __m256i name1 = _mm256_i64gather_epi64(base + 1, offset, 1);
+  const __m256i name_length = _mm256_i64gather_epi64(base + 2, offset, 1);
+  *port = _mm256_i64gather_epi64(base + 3, offset, 1);
+
+  const __m256i match = _mm256_and_si256(
+    _mm256_and_si256(_mm256_cmpeq_epi64(input0, name0),
+                     _mm256_cmpeq_epi64(input1, name1)),
+    _mm256_cmpeq_epi64(length, name_length));
+  return (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(match));
+}
+
+// load the first and second half of four names
+__attribute__((always_inline))
+static inline void load4(const char **names, __m256i *input0, __m256i *input1)
+{
+  const __m256i names02 = _mm256_loadu2_m128i(
+    (const __m128i *)names[2], (const __m128i *)names[0]);
+  const __m256i names13 = _mm256_loadu2_m128i(
+    (const __m128i *)names[3], (const __m128i *)names[1]);
+  *input0 = _mm256_unpacklo_epi64(names02, names13);
+  *input1 = _mm256_unpackhi_epi64(names02, names13);
+}
+#endif
+
+// look up n names, each must have 16 readable bytes. eight names are hashed
+// at once, the entries are gathered and compared in two groups of four, so
+// that the lookups overlap rather than follow each other
+void hash_lookup_batch(
+  const char **names, const size_t *lens, size_t n, uint16_t *ports, uint8_t *found)
+{
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  for (; n - i >= 8; i += 8) {
+    __m256i input0[2], input1[2];
+    load4(names + i, &input0[0], &input1[0]);
+    load4(names + i + 4, &input0[1], &input1[1]);
+    const __m256i length[2] = {
+      _mm256_loadu_si256((const __m256i *)(lens + i)),
+      _mm256_loadu_si256((const __m256i *)(lens + i + 4)) };
+    const __m256i offset[2] = {
+      service_hash4(input0[0], length[0]), service_hash4(input0[1], length[1]) };
+
+    __m256i port[2];
+    const uint32_t match =
+      service_compare4(input0[0], input1[0], length[0], offset[0], &port[0]) |
+      service_compare4(input0[1], input1[1], length[1], offset[1], &port[1]) << 4;
+
+    // ports are in the low 16 bits of each lane
+    const __m256i ports32 = _mm256_permutevar8x32_epi32(
+      _mm256_packus_epi32(
+        _mm256_and_si256(port[0], _mm256_set1_epi64x(0xffff)),
+        _mm256_and_si256(port[1], _mm256_set1_epi64x(0xffff))),
+      _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+    _mm_storeu_si128((__m128i *)(ports + i), _mm_packus_epi32(
+      _mm256_castsi256_si128(ports32), _mm256_extracti128_si256(ports32, 1)));
+    for (size_t j = 0; j < 8; j++)
+      found[i + j] = (match >> j) & 1u;
+  }
+#endif
+
+  for (; i < n; i++)
+    found[i] = hash_lookup(names[i], lens[i], &ports[i]);
+}